@@ -0,0 +1,315 @@
+#pragma once
+
+#ifndef __BENCHMARK_H
+#define __BENCHMARK_H
+
+#include <vector>
+#include <string>
+#include <random>
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <omp.h>
+
+#include "HashStats.hpp"
+#include "PerfCounters.hpp"
+
+//
+// Benchmark harness for the hash tables
+//
+//  A run preloads a table with keys 0 .. Preload-1, then each thread replays
+//  a pre-generated stream of operations against it:
+//   reads  - count() of a present key (HitRatio of them) or of a key that
+//            was never inserted, drawn sequentially, uniformly or Zipfian
+//   writes - emplace() of a fresh key (the share of writes is 1 - ReadRatio)
+//  Warmup repetitions run first and are thrown away. Every repetition
+//  reports its wall-clock throughput, and the p50/p99/p99.9 latencies of a
+//  sample of single operations (one in LATENCY_SAMPLE is timed on its own,
+//  so the clock reads barely disturb the throughput figure), and hardware
+//  counters per operation over the timed section (see PerfCounters.hpp).
+//
+//  Results collect in a BenchmarkSuite and can be written as CSV or JSON.
+//  Built with HASH_STATS, each table's stats() are printed after its runs.
+//
+
+enum KeyPattern { SEQUENTIAL_KEYS, UNIFORM_KEYS, ZIPF_KEYS };
+
+struct Workload {
+    std::string Name;
+    KeyPattern Keys;
+    double HitRatio;    // share of reads that find their key
+    double ReadRatio;   // share of operations that are reads
+};
+
+struct BenchmarkConfig {
+    BenchmarkConfig() : Preload(1000000), Ops(1000000), Repetitions(5), Warmup(1), MaxThreads(1), ZipfSkew(.99) {}
+    int Preload;        // keys in the table before timing starts
+    int Ops;            // operations per repetition, split over the threads
+    int Repetitions;
+    int Warmup;
+    int MaxThreads;     // thread counts 1, 2, 4, ... up to this are swept
+    double ZipfSkew;
+};
+
+struct BenchmarkResult {
+    std::string Table;
+    std::string Workload;
+    int Threads;
+    int Repetition;
+    int Ops;
+    double Seconds;
+    double OpsPerSecond;
+    double P50;         // latencies in nanoseconds
+    double P99;
+    double P999;
+    long long Counters[PerfCounters::NUM_EVENTS];   // totals over all threads, -1 if unavailable
+};
+
+// Ranks 0 .. n-1 with P(rank r) proportional to 1 / (r + 1)^Skew
+class ZipfKeys {
+private:
+    std::vector<double> Cdf;
+
+public:
+    ZipfKeys(int n, double Skew) : Cdf(n) {
+        double Sum = 0;
+        for(int R = 0; R < n; R++) {
+            Sum += 1.0 / std::pow((double)(R + 1), Skew);
+            this->Cdf[R] = Sum;
+        }
+        for(int R = 0; R < n; R++)
+            this->Cdf[R] /= Sum;
+    }
+
+    int operator()(std::mt19937_64& Random) {
+        double U = std::uniform_real_distribution<double>(0, 1)(Random);
+        return (int)(std::lower_bound(this->Cdf.begin(), this->Cdf.end(), U) - this->Cdf.begin());
+    }
+};
+
+class BenchmarkSuite {
+private:
+    enum { LATENCY_SAMPLE = 8, WRITE_BASE = 1 << 30, WRITE_SPAN = 1 << 20 };
+
+    struct Operation {
+        int Key;
+        bool Read;
+    };
+
+    BenchmarkConfig Config;
+    std::vector<BenchmarkResult> Results;
+    bool PerfReported;
+
+public:
+    explicit BenchmarkSuite(const BenchmarkConfig& config) : Config(config), PerfReported(false) {}
+
+    const std::vector<BenchmarkResult>& results() const {
+        return this->Results;
+    }
+
+    // Runs one workload on a fresh Table for every thread count in the sweep.
+    // Tables that are not safe for concurrent use pass Concurrent = false and
+    // only run single-threaded.
+    template<typename Table>
+    void run(const std::string& TableName, const Workload& W, bool Concurrent) {
+        ZipfKeys Zipf(W.Keys == ZIPF_KEYS ? this->Config.Preload : 0, this->Config.ZipfSkew);
+        for(int Threads = 1; Threads <= (Concurrent ? this->Config.MaxThreads : 1); Threads = nextThreadCount(Threads, this->Config.MaxThreads)) {
+            Table T;
+            for(int I = 0; I < this->Config.Preload; ++I)
+                T.emplace(I, I);
+            PerfCounters Perf(Threads);
+            if(!Perf.available() && !this->PerfReported)
+                std::cout << "Hardware " << Perf.report(1) << std::endl;
+            this->PerfReported = true;
+            int Total = this->Config.Warmup + this->Config.Repetitions;
+            for(int Rep = 0; Rep < Total; Rep++) {
+                BenchmarkResult Result = this->repetition(T, W, Zipf, Perf, Threads, Rep);
+                if(Rep < this->Config.Warmup)
+                    continue;
+                Result.Table = TableName;
+                Result.Repetition = Rep - this->Config.Warmup;
+                this->Results.push_back(Result);
+                this->print(this->Results.back());
+                if(Perf.available())
+                    std::cout << "    " << Perf.report(Result.Ops) << std::endl;
+            }
+            HASH_STATS_ONLY(this->print(T.stats());)
+        }
+    }
+
+    void write_csv(const std::string& Path) const {
+        std::ofstream Out(Path.c_str());
+        Out << "table,workload,threads,repetition,ops,seconds,ops_per_sec,p50_ns,p99_ns,p999_ns";
+        for(int E = 0; E < PerfCounters::NUM_EVENTS; E++)
+            Out << ',' << PerfCounters::key((PerfCounters::Event)E) << "_per_op";
+        Out << '\n';
+        for(size_t I = 0; I < this->Results.size(); I++) {
+            const BenchmarkResult& R = this->Results[I];
+            Out << R.Table << ',' << R.Workload << ',' << R.Threads << ',' << R.Repetition << ',' << R.Ops << ','
+                << R.Seconds << ',' << R.OpsPerSecond << ',' << R.P50 << ',' << R.P99 << ',' << R.P999;
+            // Unavailable counters are left empty
+            for(int E = 0; E < PerfCounters::NUM_EVENTS; E++) {
+                Out << ',';
+                if(R.Counters[E] >= 0)
+                    Out << (double)R.Counters[E] / R.Ops;
+            }
+            Out << '\n';
+        }
+    }
+
+    void write_json(const std::string& Path) const {
+        std::ofstream Out(Path.c_str());
+        Out << "{\n  \"preload\": " << this->Config.Preload << ",\n  \"zipf_skew\": " << this->Config.ZipfSkew << ",\n  \"results\": [\n";
+        for(size_t I = 0; I < this->Results.size(); I++) {
+            const BenchmarkResult& R = this->Results[I];
+            Out << "    {\"table\": \"" << R.Table << "\", \"workload\": \"" << R.Workload << "\", \"threads\": " << R.Threads
+                << ", \"repetition\": " << R.Repetition << ", \"ops\": " << R.Ops << ", \"seconds\": " << R.Seconds
+                << ", \"ops_per_sec\": " << R.OpsPerSecond << ", \"p50_ns\": " << R.P50 << ", \"p99_ns\": " << R.P99
+                << ", \"p999_ns\": " << R.P999;
+            for(int E = 0; E < PerfCounters::NUM_EVENTS; E++) {
+                Out << ", \"" << PerfCounters::key((PerfCounters::Event)E) << "_per_op\": ";
+                if(R.Counters[E] >= 0)
+                    Out << (double)R.Counters[E] / R.Ops;
+                else
+                    Out << "null";
+            }
+            Out << "}" << (I + 1 < this->Results.size() ? ",\n" : "\n");
+        }
+        Out << "  ]\n}\n";
+    }
+
+private:
+    static int nextThreadCount(int Threads, int MaxThreads) {
+        if(Threads < MaxThreads && 2 * Threads > MaxThreads)
+            return MaxThreads;
+        return 2 * Threads;
+    }
+
+    // Operations for one thread in one repetition; generated before timing
+    std::vector<Operation> operations(const Workload& W, ZipfKeys& Zipf, int Thread, int Threads, int Rep) {
+        int Count = this->Config.Ops / Threads;
+        std::vector<Operation> Ops(Count);
+        std::mt19937_64 Random((uint64_t)Rep * 1000003 + Thread);
+        std::uniform_real_distribution<double> Coin(0, 1);
+        std::uniform_int_distribution<int> Uniform(0, std::max(this->Config.Preload - 1, 0));
+        int Sequential = (int)((long)this->Config.Preload * Thread / Threads);
+        int Writes = 0;
+        for(int I = 0; I < Count; I++) {
+            Ops[I].Read = Coin(Random) < W.ReadRatio;
+            if(!Ops[I].Read || this->Config.Preload == 0) {
+                // Fresh keys: disjoint per thread and per repetition
+                Ops[I].Read = false;
+                Ops[I].Key = WRITE_BASE + ((Rep * Threads + Thread) % (WRITE_BASE / WRITE_SPAN)) * WRITE_SPAN + (Writes++ % WRITE_SPAN);
+                continue;
+            }
+            int Key;
+            if(W.Keys == SEQUENTIAL_KEYS)
+                Key = Sequential++ % this->Config.Preload;
+            else if(W.Keys == UNIFORM_KEYS)
+                Key = Uniform(Random);
+            else
+                Key = Zipf(Random);
+            // Negative keys are never inserted
+            Ops[I].Key = Coin(Random) < W.HitRatio ? Key : -1 - Key;
+        }
+        return Ops;
+    }
+
+    template<typename Table>
+    BenchmarkResult repetition(Table& T, const Workload& W, ZipfKeys& Zipf, PerfCounters& Perf, int Threads, int Rep) {
+        std::vector<std::vector<Operation>> Ops(Threads);
+        std::vector<std::vector<double>> Latencies(Threads);
+        for(int Thread = 0; Thread < Threads; Thread++)
+            Ops[Thread] = this->operations(W, Zipf, Thread, Threads, Rep);
+
+        long Found = 0;
+        double Start = 0;
+        double End = 0;
+        #pragma omp parallel num_threads(Threads) reduction(+:Found)
+        {
+            int Thread = omp_get_thread_num();
+            std::vector<Operation>& Mine = Ops[Thread];
+            std::vector<double>& Samples = Latencies[Thread];
+            Samples.reserve(Mine.size() / LATENCY_SAMPLE + 1);
+            #pragma omp barrier
+            #pragma omp single
+            {
+                Perf.start();
+                Start = omp_get_wtime();
+            }
+            for(size_t I = 0; I < Mine.size(); I++) {
+                if(I % LATENCY_SAMPLE == 0) {
+                    std::chrono::steady_clock::time_point Before = std::chrono::steady_clock::now();
+                    Found += this->apply(T, Mine[I]);
+                    std::chrono::steady_clock::time_point After = std::chrono::steady_clock::now();
+                    Samples.push_back(std::chrono::duration<double, std::nano>(After - Before).count());
+                }
+                else {
+                    Found += this->apply(T, Mine[I]);
+                }
+            }
+            #pragma omp barrier
+            #pragma omp single
+            {
+                End = omp_get_wtime();
+                Perf.stop();
+            }
+        }
+
+        std::vector<double> All;
+        for(int Thread = 0; Thread < Threads; Thread++)
+            All.insert(All.end(), Latencies[Thread].begin(), Latencies[Thread].end());
+        std::sort(All.begin(), All.end());
+
+        BenchmarkResult Result;
+        Result.Workload = W.Name;
+        Result.Threads = Threads;
+        Result.Ops = (this->Config.Ops / Threads) * Threads;
+        Result.Seconds = End - Start;
+        Result.OpsPerSecond = Result.Seconds > 0 ? Result.Ops / Result.Seconds : 0;
+        Result.P50 = percentile(All, .5);
+        Result.P99 = percentile(All, .99);
+        Result.P999 = percentile(All, .999);
+        for(int E = 0; E < PerfCounters::NUM_EVENTS; E++)
+            Result.Counters[E] = Perf.count((PerfCounters::Event)E);
+        // Keeps the reads from being optimized away
+        if(Found < 0)
+            std::cerr << Found;
+        return Result;
+    }
+
+    template<typename Table>
+    static int apply(Table& T, const Operation& Op) {
+        if(Op.Read)
+            return T.count(Op.Key);
+        T.emplace(Op.Key, Op.Key);
+        return 0;
+    }
+
+    static double percentile(const std::vector<double>& Sorted, double P) {
+        if(Sorted.empty())
+            return 0;
+        return Sorted[(size_t)(P * (Sorted.size() - 1))];
+    }
+
+    void print(const BenchmarkResult& R) {
+        std::cout << std::left << std::setw(20) << R.Table << std::setw(20) << R.Workload
+                  << std::right << std::setw(3) << R.Threads << " threads  rep " << R.Repetition
+                  << std::fixed << std::setprecision(0) << std::setw(14) << R.OpsPerSecond << " ops/s"
+                  << "  p50 " << R.P50 << " ns  p99 " << R.P99 << " ns  p99.9 " << R.P999 << " ns"
+                  << std::defaultfloat << std::endl;
+    }
+
+    void print(const HashStats& S) {
+        std::cout << std::fixed << std::setprecision(3)
+                  << "    mean probes hit " << HashStats::mean(S.HitProbes) << " miss " << HashStats::mean(S.MissProbes)
+                  << "  max cluster " << S.MaxCluster << "  tombstones " << S.TombstoneRatio
+                  << "  rehashes " << S.Rehashes << " (" << S.RehashSeconds << " s)" << std::defaultfloat << std::endl;
+    }
+};
+
+#endif //__BENCHMARK_H
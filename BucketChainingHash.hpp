@@ -0,0 +1,344 @@
+#pragma once
+
+#ifndef __BUCKET_CHAINING_HASH_H
+#define __BUCKET_CHAINING_HASH_H
+
+#include <vector>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <utility>
+#include <stdexcept>
+
+#include "Hash.hpp"
+#include "HashFunctions.hpp"
+#include "HashStats.hpp"
+
+//
+// Cache-line bucketized chaining hash table - implements Hash (via StaticHash)
+//
+//  Each bucket is one 64-byte block: a handful of inline value slots, a
+//  one-byte tag per slot taken from the hash, the number of slots in use,
+//  and a pointer to an overflow block of the same shape. A lookup reads one
+//  line, compares tags, and only touches a value whose tag matches; it
+//  leaves the line only when the bucket has spilled. Slots are kept packed
+//  (erase moves the chain's last entry into the hole), so every block but
+//  the last in a chain is full.
+//
+//  The table grows to SizePolicy::grow() of its size once the elements fill
+//  max_load_factor() (.75 by default) of the inline slots, so at that point
+//  only a small share of buckets has spilled. load_factor() reports that
+//  fill rather than elements per bucket. Overflow blocks are recycled
+//  through a free list.
+//
+template<typename K, typename V, typename Hasher = MixHash<K>, typename SizePolicy = PrimeSize>
+class BucketChainingHash : public StaticHash<BucketChainingHash<K, V, Hasher, SizePolicy>, K, V> {
+private:
+    template<typename> friend class HashAdapter;
+
+    enum {
+        LINE_SIZE = 64,
+        // Slots that fit in a line next to the overflow pointer and the count
+        FIT = (LINE_SIZE - sizeof(void*) - 1) / (sizeof(V) + 1),
+        SLOTS = FIT > 0 ? FIT : 1
+    };
+
+    struct alignas(LINE_SIZE) Block {
+        Block* Overflow;
+        uint8_t Used;
+        uint8_t Tags[SLOTS];
+        V Slots[SLOTS];
+    };
+
+    Block* Buckets;
+    int numBuckets;
+    int numElements;
+    float MaxLoad;
+    Block* FreeList;
+    Hasher HashFunction;
+    HASH_STATS_ONLY(StatsCounters Counters;)
+
+public:
+    BucketChainingHash(int n = 11) {
+        this->numBuckets = SizePolicy::size((n + SLOTS - 1) / SLOTS);
+        this->Buckets = allocate(this->numBuckets);
+        this->numElements = 0;
+        this->MaxLoad = .75;
+        this->FreeList = nullptr;
+    }
+
+    // The table owns its blocks outright, so it cannot be copied
+    BucketChainingHash(const BucketChainingHash&) = delete;
+    BucketChainingHash& operator=(const BucketChainingHash&) = delete;
+
+    ~BucketChainingHash() {
+        this->recycle(this->Buckets, this->numBuckets);
+        destroy(this->Buckets, this->numBuckets);
+        while(this->FreeList != nullptr) {
+            Block* B = this->FreeList;
+            this->FreeList = B->Overflow;
+            destroy(B, 1);
+        }
+    }
+
+    bool empty() {
+        return this->numElements == 0;
+    }
+
+    int size() {
+        return this->numElements;
+    }
+
+    V& at(const K& key) {
+        size_t H = this->hash(key);
+        uint8_t Tag = tag(H);
+        HASH_STATS_ONLY(long unsigned int Lines = 0;)
+        for(Block* B = &this->Buckets[this->home(H)]; B != nullptr; B = B->Overflow) {
+            HASH_STATS_ONLY(Lines += 1;)
+            for(int S = 0; S < B->Used; S++) {
+                if(B->Tags[S] == Tag && B->Slots[S] == key) {
+                    HASH_STATS_ONLY(this->Counters.hit(Lines);)
+                    return B->Slots[S];
+                }
+            }
+        }
+        HASH_STATS_ONLY(this->Counters.miss(Lines);)
+        throw std::out_of_range("Key not in hash");
+    }
+
+    int count(const K& key) {
+        int Size = 0;
+        size_t H = this->hash(key);
+        uint8_t Tag = tag(H);
+        HASH_STATS_ONLY(long unsigned int Lines = 0; long unsigned int First = 0;)
+        for(Block* B = &this->Buckets[this->home(H)]; B != nullptr; B = B->Overflow) {
+            HASH_STATS_ONLY(Lines += 1;)
+            for(int S = 0; S < B->Used; S++) {
+                if(B->Tags[S] == Tag && B->Slots[S] == key) {
+                    HASH_STATS_ONLY(if(Size == 0) First = Lines;)
+                    Size += 1;
+                }
+            }
+        }
+        // A hit is charged up to its first match, what at() would pay
+        HASH_STATS_ONLY(if(Size > 0) this->Counters.hit(First); else this->Counters.miss(Lines);)
+        return Size;
+    }
+
+    void emplace(K key, V value) {
+        this->add(key, std::move(value));
+    }
+
+    // Inserts V(args...) unless key is already in the table; returns
+    // whether it did. The value is constructed in its slot (see
+    // constructInPlace() in Hash.hpp), and the key is never stored.
+    template<typename... Args>
+    bool try_emplace(const K& key, Args&&... args) {
+        if(this->count(key) != 0)
+            return false;
+        this->add(key, std::forward<Args>(args)...);
+        return true;
+    }
+
+    // Removes the first entry matching key, like ChainingHash
+    void erase(const K& key) {
+        size_t H = this->hash(key);
+        uint8_t Tag = tag(H);
+        Block* Head = &this->Buckets[this->home(H)];
+        for(Block* B = Head; B != nullptr; B = B->Overflow) {
+            for(int S = 0; S < B->Used; S++) {
+                if(B->Tags[S] == Tag && B->Slots[S] == key) {
+                    this->remove(Head, B, S);
+                    this->numElements -= 1;
+                    return;
+                }
+            }
+        }
+    }
+
+    void clear() {
+        this->recycle(this->Buckets, this->numBuckets);
+        this->numElements = 0;
+    }
+
+    int bucket_count() {
+        return this->numBuckets;
+    }
+
+    int bucket_size(int n) {
+        int Size = 0;
+        for(Block* B = &this->Buckets[n]; B != nullptr; B = B->Overflow)
+            Size += B->Used;
+        return Size;
+    }
+
+    int bucket(const K& key) {
+        if(this->count(key) == 0)
+            throw std::out_of_range("Key not in hash");
+        return this->home(this->hash(key));
+    }
+
+    // Share of the inline slots in use
+    float load_factor() {
+        return (float)this->numElements / ((float)this->numBuckets * SLOTS);
+    }
+
+    void rehash() {
+        this->resize(SizePolicy::grow(this->numBuckets));
+    }
+
+    // n is a number of elements; the table gets enough lines to hold them inline
+    void rehash(int n) {
+        this->resize(SizePolicy::size((n + SLOTS - 1) / SLOTS));
+    }
+
+    float max_load_factor() {
+        return this->MaxLoad;
+    }
+
+    // Buckets spill into overflow blocks, so any positive f goes; the table
+    // grows right away if it is already above f
+    void max_load_factor(float f) {
+        if(!(f > 0))
+            throw std::invalid_argument("Max load factor must be positive");
+        this->MaxLoad = f;
+        this->reserve(this->numElements);
+    }
+
+    // Makes room for n elements, so inserting up to n never rehashes
+    void reserve(int n) {
+        if(n > (double)this->MaxLoad * this->numBuckets * SLOTS)
+            this->rehash((int)(n / (double)this->MaxLoad) + 1);
+    }
+
+    // Longest chain in entries, plus the probe histograms (in lines
+    // visited) and rehash counters when built with HASH_STATS. Erase keeps
+    // the slots packed, so there are no tombstones.
+    HashStats stats() {
+        HashStats Stats;
+        for(int I = 0; I < this->numBuckets; I++)
+            Stats.MaxCluster = std::max(Stats.MaxCluster, this->bucket_size(I));
+        HASH_STATS_ONLY(this->Counters.fill(Stats);)
+        return Stats;
+    }
+
+private:
+    template<typename... Args>
+    void add(const K& key, Args&&... args) {
+        this->place(this->Buckets, this->numBuckets, this->hash(key), std::forward<Args>(args)...);
+        this->numElements += 1;
+        if(this->load_factor() > this->MaxLoad)
+            this->resize(SizePolicy::grow(this->numBuckets));
+    }
+
+    static uint8_t tag(size_t H) {
+        return (uint8_t)(H >> 24);
+    }
+
+    int home(size_t H) {
+        return SizePolicy::index(H, this->numBuckets);
+    }
+
+    static Block* allocate(int n) {
+        void* Memory = nullptr;
+        if(posix_memalign(&Memory, LINE_SIZE, n * sizeof(Block)) != 0)
+            throw std::bad_alloc();
+        Block* Blocks = static_cast<Block*>(Memory);
+        for(int I = 0; I < n; I++)
+            new (&Blocks[I]) Block();
+        return Blocks;
+    }
+
+    static void destroy(Block* Blocks, int n) {
+        for(int I = 0; I < n; I++)
+            Blocks[I].~Block();
+        free(Blocks);
+    }
+
+    // Empties every bucket and hands its overflow blocks to the free list
+    void recycle(Block* Blocks, int n) {
+        for(int I = 0; I < n; I++) {
+            Block* B = Blocks[I].Overflow;
+            while(B != nullptr) {
+                Block* Next = B->Overflow;
+                B->Used = 0;
+                B->Overflow = this->FreeList;
+                this->FreeList = B;
+                B = Next;
+            }
+            Blocks[I].Overflow = nullptr;
+            Blocks[I].Used = 0;
+        }
+    }
+
+    Block* spill() {
+        Block* B = this->FreeList;
+        if(B != nullptr)
+            this->FreeList = B->Overflow;
+        else
+            B = allocate(1);
+        B->Overflow = nullptr;
+        B->Used = 0;
+        return B;
+    }
+
+    // The slot only counts as used once its value is built
+    template<typename... Args>
+    void place(Block* Blocks, int n, size_t H, Args&&... args) {
+        Block* B = &Blocks[SizePolicy::index(H, n)];
+        while(B->Used == SLOTS) {
+            if(B->Overflow == nullptr)
+                B->Overflow = this->spill();
+            B = B->Overflow;
+        }
+        constructInPlace(B->Slots[B->Used], std::forward<Args>(args)...);
+        B->Tags[B->Used] = tag(H);
+        B->Used += 1;
+    }
+
+    // Fills slot S of B with the last entry of the chain starting at Head,
+    // and unlinks the last block if that leaves an overflow block empty
+    void remove(Block* Head, Block* B, int S) {
+        Block* Previous = nullptr;
+        Block* Last = Head;
+        while(Last->Overflow != nullptr) {
+            Previous = Last;
+            Last = Last->Overflow;
+        }
+        Last->Used -= 1;
+        if(B != Last || S != Last->Used) {
+            B->Tags[S] = Last->Tags[Last->Used];
+            B->Slots[S] = std::move(Last->Slots[Last->Used]);
+        }
+        if(Last->Used == 0 && Previous != nullptr) {
+            Previous->Overflow = Last->Overflow;
+            Last->Overflow = this->FreeList;
+            this->FreeList = Last;
+        }
+    }
+
+    void resize(int nSize) {
+        int Minimum = SizePolicy::size((int)(this->numElements / ((double)this->MaxLoad * SLOTS)) + 1);
+        if(nSize < Minimum)
+            nSize = Minimum;
+        HASH_STATS_ONLY(this->Counters.rehash(); StatsCounters::Timer RehashTimer(this->Counters);)
+        Block* nBuckets = allocate(nSize);
+        for(int I = 0; I < this->numBuckets; I++) {
+            for(Block* B = &this->Buckets[I]; B != nullptr; B = B->Overflow) {
+                for(int S = 0; S < B->Used; S++)
+                    this->place(nBuckets, nSize, this->hash(B->Slots[S]), std::move(B->Slots[S]));
+            }
+        }
+        this->recycle(this->Buckets, this->numBuckets);
+        destroy(this->Buckets, this->numBuckets);
+        this->Buckets = nBuckets;
+        this->numBuckets = nSize;
+    }
+
+    size_t hash(const K& key) {
+        return this->HashFunction(key);
+    }
+
+};
+
+#endif //__BUCKET_CHAINING_HASH_H
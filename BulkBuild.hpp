@@ -0,0 +1,67 @@
+#pragma once
+
+#ifndef __BULK_BUILD_H
+#define __BULK_BUILD_H
+
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <omp.h>
+
+//
+// Radix partitioning for the tables' build_from bulk loaders
+//
+//  Items are grouped by which of Parts equal ranges of the table their home
+//  slot falls in. Every part then covers a disjoint slot range, so one thread
+//  per part can fill the table without synchronizing; only entries whose
+//  probe runs off the end of their range need a serial pass afterwards.
+//
+//  home(i) gives the home slot of item i. On return Order holds
+//  (home slot, item index) grouped by part, in input order within each part,
+//  and part p is Order[Offsets[p]] up to Order[Offsets[p + 1]].
+//
+template<typename HomeFunction>
+void partitionByHome(size_t n, long unsigned int Size, int Parts, HomeFunction home,
+                     std::vector<std::pair<long unsigned int, size_t>>& Order, std::vector<size_t>& Offsets) {
+    // The input is cut into Parts chunks as well; Counts[c * Parts + p] is
+    // how many items of chunk c go to part p
+    std::vector<size_t> Counts((size_t)Parts * Parts, 0);
+    std::vector<long unsigned int> Homes(n);
+    size_t Chunk = (n + Parts - 1) / Parts;
+
+    #pragma omp parallel for schedule(static) num_threads(Parts)
+    for(int C = 0; C < Parts; C++) {
+        size_t End = std::min(n, (C + 1) * Chunk);
+        for(size_t I = C * Chunk; I < End; I++) {
+            Homes[I] = home(I);
+            Counts[(size_t)C * Parts + (uint64_t)Homes[I] * Parts / Size] += 1;
+        }
+    }
+
+    // Part-major prefix sum: part p's items from chunk 0, then chunk 1, ...
+    Offsets.assign(Parts + 1, 0);
+    size_t Total = 0;
+    for(int P = 0; P < Parts; P++) {
+        Offsets[P] = Total;
+        for(int C = 0; C < Parts; C++) {
+            size_t Count = Counts[(size_t)C * Parts + P];
+            Counts[(size_t)C * Parts + P] = Total;
+            Total += Count;
+        }
+    }
+    Offsets[Parts] = Total;
+
+    Order.resize(n);
+    #pragma omp parallel for schedule(static) num_threads(Parts)
+    for(int C = 0; C < Parts; C++) {
+        size_t End = std::min(n, (C + 1) * Chunk);
+        for(size_t I = C * Chunk; I < End; I++) {
+            size_t& Next = Counts[(size_t)C * Parts + (uint64_t)Homes[I] * Parts / Size];
+            Order[Next++] = std::make_pair(Homes[I], I);
+        }
+    }
+}
+
+#endif //__BULK_BUILD_H
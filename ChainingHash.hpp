@@ -6,38 +6,105 @@
 // Standard library includes
 #include <iostream>
 #include <vector>
-#include <list>
+#include <memory>
+#include <algorithm>
 #include <stdexcept>
-#include <math.h>
+#include <type_traits>
 
 // Custom project includes
 #include "Hash.hpp"
+#include "HashFunctions.hpp"
+#include "HashStats.hpp"
+#include "SlotVector.hpp"
 
 //
-// Separate chaining based hash table - derived from Hash
+// Separate chaining based hash table - implements Hash (via StaticHash)
 //
-template<typename K, typename V>
-class ChainingHash : public Hash<K,V> {
+//  Keys are hashed with Hasher and given a bucket by SizePolicy (see
+//  HashFunctions.hpp).
+//
+//  Buckets are intrusive singly linked chains. Nodes come from slabs owned
+//  by the table: each new slab is twice the size of the previous one, so
+//  inserting n elements makes O(log n) allocations in total. Erased nodes go
+//  on a free list for the next insert. clear() rewinds the arena without
+//  freeing anything, and rehashing relinks the existing nodes, so values
+//  are never copied or moved once they are in a node. A node holds a live
+//  value only while it is on a chain: emplace() moves its value into the
+//  node, and try_emplace() constructs V(args...) there directly, only when
+//  the key is missing. Erase destroys the value before freeing the node.
+//
+//  The table grows to SizePolicy::grow() of its size once the elements
+//  outnumber max_load_factor() (.75 by default) times the buckets; reserve()
+//  makes room up front for a load of known size.
+//
+//  With incremental_rehash(true) the old bucket vector is kept as OldTable
+//  when the table grows, and every insert, erase and lookup relinks the nodes
+//  of at most REHASH_STEP old buckets into the new one; lookups and erases
+//  check both until OldTable is drained. The one O(n) piece left in the
+//  triggering insert is allocating the new bucket vector.
+//
+//  Allocator supplies the bucket vectors and the slabs. HugePageAllocator
+//  (see HugePageAllocator.hpp) puts large ones on huge pages and hands back
+//  zeroed memory, so a new bucket vector needs no pass to null its heads.
+//
+template<typename K, typename V, typename Hasher = MixHash<K>, typename SizePolicy = PrimeSize, typename Allocator = std::allocator<V>>
+class ChainingHash : public StaticHash<ChainingHash<K, V, Hasher, SizePolicy, Allocator>, K, V> {
 private:
-    std::vector<std::list<V>> Table;
+    template<typename> friend class HashAdapter;
+
+    enum { REHASH_STEP = 8, FIRST_SLAB = 64, MAX_SLAB_SHIFT = 16, BATCH_WINDOW = 16 };
+
+    // Raw storage until allocate() constructs a value in it
+    struct Node {
+        alignas(V) unsigned char Storage[sizeof(V)];
+        Node* Next;
+
+        V& value() {
+            return *reinterpret_cast<V*>(this->Storage);
+        }
+    };
+
+    typedef SlotVector<Node*, Allocator> BucketVector;
+
+    BucketVector Table;
     int numElements;
+    float MaxLoad;
+
+    BucketVector OldTable;
+    long unsigned int MigrateIndex;
+    bool Incremental;
+    Hasher HashFunction;
+    HASH_STATS_ONLY(StatsCounters Counters;)
+
+    // Node arena: Slabs[SlabIndex] is being handed out, SlabUsed nodes in
+    std::vector<SlotVector<Node, Allocator>> Slabs;
+    long unsigned int SlabIndex;
+    int SlabUsed;
+    Node* FreeList;
 
 public:
     ChainingHash(int n = 11) {
-        this->Table.resize(n);
+        this->Table.reset(SizePolicy::size(n));
         this->numElements = 0;
+        this->MaxLoad = .75;
+        this->MigrateIndex = 0;
+        this->Incremental = false;
+        this->SlabIndex = 0;
+        this->SlabUsed = 0;
+        this->FreeList = nullptr;
     }
 
+    // Table and OldTable hold pointers into the slabs, so the table cannot be copied
+    ChainingHash(const ChainingHash&) = delete;
+    ChainingHash& operator=(const ChainingHash&) = delete;
+
     ~ChainingHash() {
-        this->clear();
+        // The slabs free every node
+        this->destroyValues();
     }
 
     bool empty() {
-        for(long unsigned int I = 0; I < this->Table.size(); I++) {
-            if(!this->Table[I].empty())
-                return false;
-        }
-        return true;
+        return this->numElements == 0;
     }
 
     int size() {
@@ -45,62 +112,53 @@ public:
     }
 
     V& at(const K& key) {
-        int Index = this->hash(key) % this->Table.size();
-        for(auto it = this->Table[Index].begin(); it != this->Table[Index].end(); ++it) {
-            if(*it == key)
-                return *it;
-        }
-        //throw std::out_of_range("Key not in hash");
-    }
-
-    V& operator[](const K& key) {
-        int Index = this->hash(key) % this->Table.size();
-        for(auto it = this->Table[Index].begin(); it != this->Table[Index].end(); ++it) {
-            if(*it == key)
-                return *it;
-        }
-        //throw std::out_of_range("Key not in hash");
+        this->step();
+        Node* Found = this->find(this->Table, key);
+        if(Found == nullptr)
+            Found = this->find(this->OldTable, key);
+        if(Found == nullptr)
+            throw std::out_of_range("Key not in hash");
+        return Found->value();
     }
 
     int count(const K& key) {
-        int Size = 0;
-        int Index = this->hash(key) % this->Table.size();
-        for(auto it = this->Table[Index].begin(); it != this->Table[Index].end(); ++it) {
-            ++Size;
-        }
-        return Size;
+        this->step();
+        return this->count(this->Table, key) + this->count(this->OldTable, key);
     }
 
     void emplace(K key, V value) {
-        this->Table[this->hash(key) % this->Table.size()].push_back(value);
-        this->numElements += 1;
-        if(this->load_factor() > .75)
-            this->rehash();
+        this->add(key, std::move(value));
     }
 
-    void insert(const std::pair<K, V>& pair) {
-        this->Table[this->hash(pair.first) % this->Table.size()].push_back(pair.second);
-        this->numElements += 1;
-        if(this->load_factor() > .75)
-            this->rehash();
+    // Inserts V(args...) unless key is already in the table; returns
+    // whether it did. The value is constructed in its node. The key only
+    // picks the bucket, so it is never copied or moved, and one const K&
+    // takes rvalue keys as well.
+    template<typename... Args>
+    bool try_emplace(const K& key, Args&&... args) {
+        if(this->count(key) != 0)
+            return false;
+        this->add(key, std::forward<Args>(args)...);
+        return true;
     }
 
     void erase(const K& key) {
-        int Index = this->hash(key) % this->Table.size();
-        for(auto it = this->Table[Index].begin(); it != this->Table[Index].end(); ++it) {
-            if(*it == key) {
-                this->Table[Index].erase(it);
-                this->numElements -= 1;
-                return;
-            }
-        }
+        this->step();
+        if(!this->erase(this->Table, key))
+            this->erase(this->OldTable, key);
     }
 
+    // Rewinds the arena; only the bucket heads are reset, once the values
+    // on the chains are destroyed (a no-op for trivially destructible V)
     void clear() {
-        for(long unsigned int I = 0; I < this->Table.size(); I++) {
-            this->Table[I].clear();
-        }
-        this->Table.clear(); //////////////////////// 
+        this->destroyValues();
+        std::fill(this->Table.data(), this->Table.data() + this->Table.size(), nullptr);
+        BucketVector().swap(this->OldTable);
+        this->MigrateIndex = 0;
+        this->numElements = 0;
+        this->SlabIndex = 0;
+        this->SlabUsed = 0;
+        this->FreeList = nullptr;
     }
 
     int bucket_count() {
@@ -108,15 +166,19 @@ public:
     }
 
     int bucket_size(int n) {
-        return this->Table[n].size();
+        int Size = 0;
+        for(Node* N = this->Table[n]; N != nullptr; N = N->Next)
+            Size += 1;
+        return Size;
     }
 
+    // While a rehash is in progress a key still waiting in the old table
+    // reports its bucket there
     int bucket(const K& key) {
-        int Index = this->hash(key) % this->Table.size();
-        for(auto it = this->Table[Index].begin(); it != this->Table[Index].end(); ++it) {
-            if(*it == key)
-                return Index;
-        }
+        if(this->find(this->Table, key) != nullptr)
+            return this->home(key, this->Table.size());
+        if(this->find(this->OldTable, key) != nullptr)
+            return this->home(key, this->OldTable.size());
         throw std::out_of_range("Key not in hash");
     }
 
@@ -125,57 +187,295 @@ public:
     }
 
     void rehash() {
-        int nSize = this->findNextPrime(2 * this->Table.size());
-        std::vector<std::list<V>> nTable;
-        nTable.resize(nSize);
-        
-        for(long unsigned int I = 0; I < this->Table.size(); I++) {
-            for(auto it = this->Table[I].begin(); it != this->Table[I].end(); ++it) {
-                nTable[this->hash(*it) % nSize].push_back(*it);
-            }
-        }
-        this->Table = nTable;
+        this->drain();
+        this->resize(SizePolicy::grow(this->Table.size()));
     }
 
     void rehash(int n) {
-        int nSize = this->findNextPrime(n);
-        std::vector<std::list<V>> nTable;
-        nTable.resize(n);
-        
-        for(long unsigned int I = 0; I < this->Table.size(); I++) {
-            for(auto it = this->Table[I].begin(); it != this->Table[I].end(); ++it) {
-                nTable[this->hash(*it) % nSize].push_back(*it);
+        this->drain();
+        this->resize(SizePolicy::size(n));
+    }
+
+    float max_load_factor() {
+        return this->MaxLoad;
+    }
+
+    // Chains can run past one element per bucket, so any positive f goes;
+    // the table grows right away if it is already above f
+    void max_load_factor(float f) {
+        if(!(f > 0))
+            throw std::invalid_argument("Max load factor must be positive");
+        this->MaxLoad = f;
+        this->reserve(this->numElements);
+    }
+
+    // Makes room for n elements, so inserting up to n never rehashes
+    void reserve(int n) {
+        if(n > (double)this->MaxLoad * this->Table.size())
+            this->rehash((int)(n / (double)this->MaxLoad) + 1);
+    }
+
+    // Looks up n keys at once: out[i] points at the value for keys[i], or is
+    // nullptr if it is missing. Two prefetch stages run ahead of the walk:
+    // the bucket of key i + BATCH_WINDOW, and the first node of key
+    // i + BATCH_WINDOW / 2, whose bucket arrived by then.
+    void find_batch(const K* keys, size_t n, V** out) {
+        for(size_t I = 0; I < n; I++)
+            this->step();
+        Node** Buckets[BATCH_WINDOW];
+        Node* Heads[BATCH_WINDOW];
+        for(size_t I = 0; I < n && I < BATCH_WINDOW; I++)
+            Buckets[I] = this->prefetch(keys[I], 0);
+        for(size_t I = 0; I < n && I < BATCH_WINDOW / 2; I++)
+            Heads[I] = this->prefetch(Buckets[I]);
+        for(size_t I = 0; I < n; I++) {
+            Node* Head = Heads[I % BATCH_WINDOW];
+            if(I + BATCH_WINDOW / 2 < n)
+                Heads[(I + BATCH_WINDOW / 2) % BATCH_WINDOW] = this->prefetch(Buckets[(I + BATCH_WINDOW / 2) % BATCH_WINDOW]);
+            if(I + BATCH_WINDOW < n)
+                Buckets[I % BATCH_WINDOW] = this->prefetch(keys[I + BATCH_WINDOW], 0);
+            Node* Found = this->findFrom(Head, keys[I]);
+            if(Found == nullptr)
+                Found = this->find(this->OldTable, keys[I]);
+            out[I] = Found != nullptr ? &Found->value() : nullptr;
+        }
+    }
+
+    // Inserts keys[i] -> values[i] for i < n, prefetching the buckets of a
+    // window of keys before linking any of them. The table grows ahead of
+    // each window so the precomputed buckets stay valid.
+    void insert_batch(const K* keys, const V* values, size_t n) {
+        Node** Buckets[BATCH_WINDOW];
+        for(size_t Start = 0; Start < n; Start += BATCH_WINDOW) {
+            size_t Count = std::min(n - Start, (size_t)BATCH_WINDOW);
+            for(size_t I = 0; I < Count; I++)
+                this->step();
+            while(this->numElements + Count > this->MaxLoad * this->Table.size())
+                this->grow();
+            for(size_t I = 0; I < Count; I++)
+                Buckets[I] = this->prefetch(keys[Start + I], 1);
+            for(size_t I = 0; I < Count; I++) {
+                Node* N = this->allocate(values[Start + I]);
+                N->Next = *Buckets[I];
+                *Buckets[I] = N;
             }
+            this->numElements += Count;
         }
-        this->Table = nTable;
     }
 
+    // Spread the cost of growing over the following operations instead of
+    // paying it all in the insert that crosses the load factor
+    void incremental_rehash(bool on) {
+        if(!on)
+            this->drain();
+        this->Incremental = on;
+    }
+
+    // Longest chain, plus the probe histograms (in nodes visited) and
+    // rehash counters when built with HASH_STATS. Chains leave no tombstones.
+    HashStats stats() {
+        HashStats Stats;
+        for(long unsigned int I = 0; I < this->Table.size(); I++)
+            Stats.MaxCluster = std::max(Stats.MaxCluster, this->bucket_size(I));
+        HASH_STATS_ONLY(this->Counters.fill(Stats);)
+        return Stats;
+    }
 
 private:
-    int findNextPrime(int n)
-    {
-        while (!isPrime(n))
-        {
-            n++;
+    template<typename... Args>
+    void add(const K& key, Args&&... args) {
+        this->step();
+        Node* N = this->allocate(std::forward<Args>(args)...);
+        Node*& Bucket = this->Table[this->home(key, this->Table.size())];
+        N->Next = Bucket;
+        Bucket = N;
+        this->numElements += 1;
+        if(this->load_factor() > this->MaxLoad)
+            this->grow();
+    }
+
+    int home(const K& key, long unsigned int Size) {
+        return SizePolicy::index(this->hash(key), Size);
+    }
+
+    // Bucket of key in Table, with its cache line already requested
+    Node** prefetch(const K& key, int Write) {
+        Node** Bucket = &this->Table[this->home(key, this->Table.size())];
+        if(Write)
+            __builtin_prefetch(Bucket, 1);
+        else
+            __builtin_prefetch(Bucket, 0);
+        return Bucket;
+    }
+
+    // Head of an already prefetched bucket, with the head node requested too
+    Node* prefetch(Node** Bucket) {
+        Node* Head = *Bucket;
+        if(Head != nullptr)
+            __builtin_prefetch(Head);
+        return Head;
+    }
+
+    Node* find(BucketVector& T, const K& key) {
+        if(T.empty())
+            return nullptr;
+        return this->findFrom(T[this->home(key, T.size())], key);
+    }
+
+    Node* findFrom(Node* N, const K& key) {
+        HASH_STATS_ONLY(long unsigned int Probes = 0;)
+        for(; N != nullptr; N = N->Next) {
+            HASH_STATS_ONLY(Probes += 1;)
+            if(N->value() == key) {
+                HASH_STATS_ONLY(this->Counters.hit(Probes);)
+                return N;
+            }
         }
-        return n;
+        HASH_STATS_ONLY(this->Counters.miss(Probes);)
+        return nullptr;
     }
 
-    int isPrime(int n)
-    {
-        for (int i = 2; i <= std::sqrt(n); i++)
-        {
-            if (n % i == 0)
-            {
-                return false;
+    int count(BucketVector& T, const K& key) {
+        int Size = 0;
+        if(T.empty())
+            return 0;
+        HASH_STATS_ONLY(long unsigned int Probes = 0; long unsigned int First = 0;)
+        for(Node* N = T[this->home(key, T.size())]; N != nullptr; N = N->Next) {
+            HASH_STATS_ONLY(Probes += 1;)
+            if(N->value() == key) {
+                HASH_STATS_ONLY(if(Size == 0) First = Probes;)
+                ++Size;
             }
         }
+        // A hit is charged up to its first match, what find() would pay
+        HASH_STATS_ONLY(if(Size > 0) this->Counters.hit(First); else this->Counters.miss(Probes);)
+        return Size;
+    }
 
-        return true;
+    // Unlinks the first node matching key and puts it on the free list
+    bool erase(BucketVector& T, const K& key) {
+        if(T.empty())
+            return false;
+        for(Node** Link = &T[this->home(key, T.size())]; *Link != nullptr; Link = &(*Link)->Next) {
+            Node* N = *Link;
+            if(N->value() == key) {
+                *Link = N->Next;
+                N->value().~V();
+                N->Next = this->FreeList;
+                this->FreeList = N;
+                this->numElements -= 1;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Takes a node from the free list or the current slab and constructs
+    // V(args...) in it; if that throws, the node goes on the free list
+    template<typename... Args>
+    Node* allocate(Args&&... args) {
+        Node* N = this->FreeList;
+        if(N != nullptr) {
+            this->FreeList = N->Next;
+        }
+        else {
+            if(this->SlabUsed == slabSize(this->SlabIndex)) {
+                this->SlabIndex += 1;
+                this->SlabUsed = 0;
+            }
+            if(this->SlabIndex == this->Slabs.size()) {
+                this->Slabs.emplace_back();
+                this->Slabs.back().reset(slabSize(this->SlabIndex), false);
+            }
+            N = &this->Slabs[this->SlabIndex][this->SlabUsed++];
+        }
+        try {
+            ::new((void*)N->Storage) V(std::forward<Args>(args)...);
+        }
+        catch(...) {
+            N->Next = this->FreeList;
+            this->FreeList = N;
+            throw;
+        }
+        return N;
+    }
+
+    // Ends the life of every value on a chain of either bucket vector
+    void destroyValues() {
+        if(std::is_trivially_destructible<V>::value)
+            return;
+        BucketVector* Vectors[] = { &this->Table, &this->OldTable };
+        for(int T = 0; T < 2; T++) {
+            for(long unsigned int I = 0; I < Vectors[T]->size(); I++) {
+                for(Node* N = (*Vectors[T])[I]; N != nullptr; N = N->Next)
+                    N->value().~V();
+            }
+        }
+    }
+
+    static int slabSize(long unsigned int Index) {
+        return FIRST_SLAB << std::min(Index, (long unsigned int)MAX_SLAB_SHIFT);
+    }
+
+    // Moves every node of Bucket into nTable without copying or allocating
+    void relink(Node*& Bucket, BucketVector& nTable) {
+        while(Bucket != nullptr) {
+            Node* N = Bucket;
+            Bucket = N->Next;
+            Node*& Target = nTable[this->home(N->value(), nTable.size())];
+            N->Next = Target;
+            Target = N;
+        }
+    }
+
+    void grow() {
+        int nSize = SizePolicy::grow(this->Table.size());
+        if(!this->Incremental) {
+            this->resize(nSize);
+            return;
+        }
+        // REHASH_STEP is large enough that the previous move has always
+        // finished by the time the new table fills up; drain() is a safety net
+        this->drain();
+        HASH_STATS_ONLY(this->Counters.rehash(); StatsCounters::Timer RehashTimer(this->Counters);)
+        this->OldTable.swap(this->Table);
+        this->Table.reset(nSize);
+        this->MigrateIndex = 0;
+    }
+
+    // Moves up to REHASH_STEP buckets of the old table into the current one
+    void step() {
+        if(this->OldTable.empty())
+            return;
+        HASH_STATS_ONLY(StatsCounters::Timer RehashTimer(this->Counters);)
+        long unsigned int End = std::min(this->OldTable.size(), this->MigrateIndex + REHASH_STEP);
+        for(; this->MigrateIndex < End; this->MigrateIndex++)
+            this->relink(this->OldTable[this->MigrateIndex], this->Table);
+        if(this->MigrateIndex == this->OldTable.size()) {
+            BucketVector().swap(this->OldTable);
+            this->MigrateIndex = 0;
+        }
+    }
+
+    void drain() {
+        while(!this->OldTable.empty())
+            this->step();
     }
 
-    int hash(const K& key) {
-        return (int)key;       
+    void resize(int nSize) {
+        HASH_STATS_ONLY(this->Counters.rehash(); StatsCounters::Timer RehashTimer(this->Counters);)
+        BucketVector nTable;
+        nTable.reset(nSize);
+
+        for(long unsigned int I = 0; I < this->Table.size(); I++) {
+            this->relink(this->Table[I], nTable);
+        }
+        this->Table.swap(nTable);
+    }
+
+
+    size_t hash(const K& key) {
+        return this->HashFunction(key);
     }
 
 };
@@ -0,0 +1,439 @@
+#pragma once
+
+#ifndef __CUCKOO_HASH_H
+#define __CUCKOO_HASH_H
+
+#include <vector>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <utility>
+#include <algorithm>
+#include <stdexcept>
+
+#include "Hash.hpp"
+#include "HashFunctions.hpp"
+#include "HashStats.hpp"
+
+//
+// Bucketized cuckoo hash table - implements Hash (via StaticHash)
+//
+//  Every key has two candidate buckets, one from its hash and one from a
+//  second mix of that hash, and lives in one of them. A bucket is one
+//  64-byte line of up to eight slots with a one-byte tag per slot (0 marks
+//  a free slot), so a lookup reads at most two lines whatever the load;
+//  there are no probe sequences or chains to walk.
+//
+//  An insert takes a free slot in either bucket if there is one. Otherwise
+//  a breadth-first search over the entries of both buckets, each of which
+//  could move to its own other bucket, looks for the shortest chain of
+//  moves that ends in a free slot, and the chain is shifted along one entry
+//  at a time. The search gives up after MAX_SEARCH buckets, and the table
+//  then grows. With eight slots per bucket the search rarely fails below
+//  MAX_LOAD, so the table runs up to 95% full by default; max_load_factor()
+//  can lower that, but not raise it. Growing goes to SizePolicy::grow() of
+//  the bucket count. load_factor() reports the fill of the slots.
+//
+//  A key can only ever have 2 * SLOTS entries; emplacing more throws
+//  std::length_error.
+//
+template<typename K, typename V, typename Hasher = MixHash<K>, typename SizePolicy = PrimeSize>
+class CuckooHash : public StaticHash<CuckooHash<K, V, Hasher, SizePolicy>, K, V> {
+private:
+    template<typename> friend class HashAdapter;
+
+    enum {
+        LINE_SIZE = 64,
+        FIT = LINE_SIZE / (sizeof(V) + 1),
+        SLOTS = FIT > 8 ? 8 : (FIT > 0 ? FIT : 1),
+        MAX_SEARCH = 1024,
+        MAX_DEPTH = 5
+    };
+
+    // Grow before the search has to work too hard: the default and the
+    // highest max_load_factor()
+    static constexpr float MAX_LOAD = .95f;
+
+    struct alignas(LINE_SIZE) Bucket {
+        uint8_t Tags[SLOTS];
+        V Slots[SLOTS];
+    };
+
+    // A bucket the search reached by moving slot Slot of node Parent's bucket
+    struct SearchNode {
+        int Bucket;
+        int Parent;
+        int Slot;
+        int Depth;
+    };
+
+    Bucket* Buckets;
+    int numBuckets;
+    int numElements;
+    float MaxLoad;
+    std::vector<SearchNode> Search;
+    Hasher HashFunction;
+    HASH_STATS_ONLY(StatsCounters Counters;)
+
+public:
+    CuckooHash(int n = 11) {
+        this->numBuckets = SizePolicy::size((n + SLOTS - 1) / SLOTS);
+        this->Buckets = allocate(this->numBuckets);
+        this->numElements = 0;
+        this->MaxLoad = MAX_LOAD;
+    }
+
+    // The table owns its bucket array outright, so it cannot be copied
+    CuckooHash(const CuckooHash&) = delete;
+    CuckooHash& operator=(const CuckooHash&) = delete;
+
+    ~CuckooHash() {
+        destroy(this->Buckets, this->numBuckets);
+    }
+
+    bool empty() {
+        return this->numElements == 0;
+    }
+
+    int size() {
+        return this->numElements;
+    }
+
+    V& at(const K& key) {
+        size_t H = this->hash(key);
+        uint8_t Tag = tag(H);
+        int First = this->first(H);
+        int Second = this->second(H);
+        int Slot = this->findIn(First, Tag, key);
+        if(Slot >= 0) {
+            HASH_STATS_ONLY(this->Counters.hit(1);)
+            return this->Buckets[First].Slots[Slot];
+        }
+        Slot = this->findIn(Second, Tag, key);
+        if(Slot >= 0) {
+            HASH_STATS_ONLY(this->Counters.hit(2);)
+            return this->Buckets[Second].Slots[Slot];
+        }
+        HASH_STATS_ONLY(this->Counters.miss(2);)
+        throw std::out_of_range("Key not in hash");
+    }
+
+    int count(const K& key) {
+        size_t H = this->hash(key);
+        uint8_t Tag = tag(H);
+        int First = this->first(H);
+        int Second = this->second(H);
+        int Size = this->countIn(First, Tag, key);
+        HASH_STATS_ONLY(long unsigned int Lines = Size > 0 ? 1 : 2;)
+        if(Second != First)
+            Size += this->countIn(Second, Tag, key);
+        // A hit is charged up to its first match, what at() would pay
+        HASH_STATS_ONLY(if(Size > 0) this->Counters.hit(Lines); else this->Counters.miss(Lines);)
+        return Size;
+    }
+
+    void emplace(K key, V value) {
+        this->add(key, std::move(value));
+    }
+
+    // Inserts V(args...) unless key is already in the table; returns
+    // whether it did. The key is never stored. The value is constructed in
+    // its slot (see constructInPlace() in Hash.hpp) when one of its buckets
+    // has room; otherwise it is built first, since making room moves entries
+    // that args might refer to.
+    template<typename... Args>
+    bool try_emplace(const K& key, Args&&... args) {
+        if(this->count(key) != 0)
+            return false;
+        this->add(key, std::forward<Args>(args)...);
+        return true;
+    }
+
+    // Removes every entry matching key
+    void erase(const K& key) {
+        size_t H = this->hash(key);
+        uint8_t Tag = tag(H);
+        int First = this->first(H);
+        int Second = this->second(H);
+        this->numElements -= this->eraseIn(First, Tag, key);
+        if(Second != First)
+            this->numElements -= this->eraseIn(Second, Tag, key);
+    }
+
+    void clear() {
+        for(int I = 0; I < this->numBuckets; I++)
+            std::fill(this->Buckets[I].Tags, this->Buckets[I].Tags + SLOTS, 0);
+        this->numElements = 0;
+    }
+
+    int bucket_count() {
+        return this->numBuckets;
+    }
+
+    int bucket_size(int n) {
+        int Size = 0;
+        for(int S = 0; S < SLOTS; S++)
+            Size += this->Buckets[n].Tags[S] != 0;
+        return Size;
+    }
+
+    int bucket(const K& key) {
+        size_t H = this->hash(key);
+        if(this->findIn(this->first(H), tag(H), key) >= 0)
+            return this->first(H);
+        if(this->findIn(this->second(H), tag(H), key) >= 0)
+            return this->second(H);
+        throw std::out_of_range("Key not in hash");
+    }
+
+    // Share of the slots in use
+    float load_factor() {
+        return (float)this->numElements / ((float)this->numBuckets * SLOTS);
+    }
+
+    void rehash() {
+        this->resize(SizePolicy::grow(this->numBuckets));
+    }
+
+    // n is a number of elements; the table gets enough buckets to hold them
+    void rehash(int n) {
+        this->resize(SizePolicy::size((n + SLOTS - 1) / SLOTS));
+    }
+
+    float max_load_factor() {
+        return this->MaxLoad;
+    }
+
+    // Grows the table right away if it is already above f
+    void max_load_factor(float f) {
+        if(!(f > 0 && f <= MAX_LOAD))
+            throw std::invalid_argument("Max load factor must be between 0 and .95");
+        this->MaxLoad = f;
+        this->reserve(this->numElements);
+    }
+
+    // Makes room for n elements, so inserting up to n only grows the table
+    // if a cuckoo search fails
+    void reserve(int n) {
+        if(n > (double)this->MaxLoad * this->numBuckets * SLOTS)
+            this->rehash((int)(n / (double)this->MaxLoad) + 1);
+    }
+
+    // Longest run of full buckets, plus the probe histograms (in lines
+    // visited, one or two) and rehash counters when built with HASH_STATS.
+    // Erase just frees the slot, so there are no tombstones.
+    HashStats stats() {
+        HashStats Stats;
+        Stats.MaxCluster = longestRun(this->numBuckets, [&](long unsigned int I) { return this->bucket_size((int)I) == SLOTS; });
+        HASH_STATS_ONLY(this->Counters.fill(Stats);)
+        return Stats;
+    }
+
+private:
+    template<typename... Args>
+    void add(const K& key, Args&&... args) {
+        size_t H = this->hash(key);
+        int B;
+        int Slot;
+        if(this->openSlot(H, B, Slot)) {
+            this->put(B, Slot, H, std::forward<Args>(args)...);
+        }
+        else {
+            V Value(std::forward<Args>(args)...);
+            while(!this->place(H, std::move(Value))) {
+                if(this->count(key) >= 2 * SLOTS)
+                    throw std::length_error("Too many entries for one key");
+                this->resize(SizePolicy::grow(this->numBuckets));
+            }
+        }
+        this->numElements += 1;
+        if(this->numElements > this->MaxLoad * this->numBuckets * SLOTS)
+            this->resize(SizePolicy::grow(this->numBuckets));
+    }
+
+    static uint8_t tag(size_t H) {
+        uint8_t Tag = (uint8_t)(H >> 24);
+        return Tag != 0 ? Tag : 1;
+    }
+
+    int first(size_t H) {
+        return SizePolicy::index(H, this->numBuckets);
+    }
+
+    int second(size_t H) {
+        return SizePolicy::index((size_t)mix64((uint64_t)H), this->numBuckets);
+    }
+
+    static Bucket* allocate(int n) {
+        void* Memory = nullptr;
+        if(posix_memalign(&Memory, LINE_SIZE, n * sizeof(Bucket)) != 0)
+            throw std::bad_alloc();
+        Bucket* Blocks = static_cast<Bucket*>(Memory);
+        for(int I = 0; I < n; I++) {
+            new (&Blocks[I]) Bucket();
+            std::fill(Blocks[I].Tags, Blocks[I].Tags + SLOTS, 0);
+        }
+        return Blocks;
+    }
+
+    static void destroy(Bucket* Blocks, int n) {
+        for(int I = 0; I < n; I++)
+            Blocks[I].~Bucket();
+        free(Blocks);
+    }
+
+    int findIn(int B, uint8_t Tag, const K& key) {
+        Bucket& Line = this->Buckets[B];
+        for(int S = 0; S < SLOTS; S++) {
+            if(Line.Tags[S] == Tag && Line.Slots[S] == key)
+                return S;
+        }
+        return -1;
+    }
+
+    int countIn(int B, uint8_t Tag, const K& key) {
+        Bucket& Line = this->Buckets[B];
+        int Size = 0;
+        for(int S = 0; S < SLOTS; S++)
+            Size += Line.Tags[S] == Tag && Line.Slots[S] == key;
+        return Size;
+    }
+
+    int eraseIn(int B, uint8_t Tag, const K& key) {
+        Bucket& Line = this->Buckets[B];
+        int Erased = 0;
+        for(int S = 0; S < SLOTS; S++) {
+            if(Line.Tags[S] == Tag && Line.Slots[S] == key) {
+                Line.Tags[S] = 0;
+                Erased += 1;
+            }
+        }
+        return Erased;
+    }
+
+    int freeSlot(int B) {
+        for(int S = 0; S < SLOTS; S++) {
+            if(this->Buckets[B].Tags[S] == 0)
+                return S;
+        }
+        return -1;
+    }
+
+    // A free slot in one of hash H's two buckets, without moving anything
+    bool openSlot(size_t H, int& B, int& Slot) {
+        B = this->first(H);
+        Slot = this->freeSlot(B);
+        if(Slot < 0) {
+            B = this->second(H);
+            Slot = this->freeSlot(B);
+        }
+        return Slot >= 0;
+    }
+
+    // The slot is tagged once its value is built
+    template<typename... Args>
+    void put(int B, int Slot, size_t H, Args&&... args) {
+        constructInPlace(this->Buckets[B].Slots[Slot], std::forward<Args>(args)...);
+        this->Buckets[B].Tags[Slot] = tag(H);
+    }
+
+    // Moves value into one of its two buckets, making room if it has to;
+    // false, with value untouched, if the search found no room
+    bool place(size_t H, V&& value) {
+        int B;
+        int Slot;
+        if(!this->openSlot(H, B, Slot) && !this->makeRoom(this->first(H), this->second(H), B, Slot))
+            return false;
+        this->put(B, Slot, H, std::move(value));
+        return true;
+    }
+
+    // Breadth-first search from both buckets for a chain of moves ending in
+    // a free slot. No bucket appears twice on one chain, so shifting the
+    // chain back from its free end never moves an entry that has already
+    // moved. On success B and Slot name the slot the chain freed.
+    bool makeRoom(int First, int Second, int& B, int& Slot) {
+        this->Search.clear();
+        SearchNode Root = { First, -1, -1, 0 };
+        this->Search.push_back(Root);
+        if(Second != First) {
+            Root.Bucket = Second;
+            this->Search.push_back(Root);
+        }
+        for(size_t I = 0; I < this->Search.size(); I++) {
+            SearchNode Node = this->Search[I];
+            int Free = this->freeSlot(Node.Bucket);
+            if(Free >= 0) {
+                this->shift((int)I, Free, B, Slot);
+                return true;
+            }
+            if(Node.Depth == MAX_DEPTH)
+                continue;
+            for(int S = 0; S < SLOTS && this->Search.size() < MAX_SEARCH; S++) {
+                size_t H = this->hash(this->Buckets[Node.Bucket].Slots[S]);
+                int Other = this->first(H) == Node.Bucket ? this->second(H) : this->first(H);
+                if(Other == Node.Bucket || this->onChain((int)I, Other))
+                    continue;
+                SearchNode Child = { Other, (int)I, S, Node.Depth + 1 };
+                this->Search.push_back(Child);
+            }
+        }
+        return false;
+    }
+
+    bool onChain(int Node, int B) {
+        for(; Node >= 0; Node = this->Search[Node].Parent) {
+            if(this->Search[Node].Bucket == B)
+                return true;
+        }
+        return false;
+    }
+
+    // Moves each entry on the chain ending at Node into the slot freed after
+    // it, starting with the free slot Free
+    void shift(int Node, int Free, int& B, int& Slot) {
+        while(this->Search[Node].Parent >= 0) {
+            const SearchNode& Step = this->Search[Node];
+            Bucket& From = this->Buckets[this->Search[Step.Parent].Bucket];
+            Bucket& To = this->Buckets[Step.Bucket];
+            To.Tags[Free] = From.Tags[Step.Slot];
+            To.Slots[Free] = std::move(From.Slots[Step.Slot]);
+            From.Tags[Step.Slot] = 0;
+            Free = Step.Slot;
+            Node = Step.Parent;
+        }
+        B = this->Search[Node].Bucket;
+        Slot = Free;
+    }
+
+    // Rebuilds at nSize buckets, or bigger if the entries do not all fit.
+    // Entries are moved over one at a time; if the search fails for one, the
+    // new table grows in turn, taking the entries it already holds along.
+    void resize(int nSize) {
+        int Minimum = SizePolicy::size((int)(this->numElements / ((double)this->MaxLoad * SLOTS)) + 1);
+        if(nSize < Minimum)
+            nSize = Minimum;
+        HASH_STATS_ONLY(this->Counters.rehash(); StatsCounters::Timer RehashTimer(this->Counters);)
+        Bucket* Old = this->Buckets;
+        int OldSize = this->numBuckets;
+        this->Buckets = allocate(nSize);
+        this->numBuckets = nSize;
+        for(int I = 0; I < OldSize; I++) {
+            for(int S = 0; S < SLOTS; S++) {
+                if(Old[I].Tags[S] == 0)
+                    continue;
+                size_t H = this->hash(Old[I].Slots[S]);
+                while(!this->place(H, std::move(Old[I].Slots[S])))
+                    this->resize(SizePolicy::grow(this->numBuckets));
+            }
+        }
+        destroy(Old, OldSize);
+    }
+
+    size_t hash(const K& key) {
+        return this->HashFunction(key);
+    }
+
+};
+
+#endif //__CUCKOO_HASH_H
@@ -2,6 +2,11 @@
 #ifndef __Hash_H
 #define __Hash_H
 
+#include <new>
+#include <cstddef>
+#include <utility>
+#include <type_traits>
+
 // Hash class interface notes
 // ******************PUBLIC OPERATIONS*********************
 // bool empty( )                            --> Test for empty hash
@@ -11,6 +16,7 @@
 // int count( const K& key )                --> Returns the number of elements with key k
 // bool emplace ( const K& key, V& value )  --> Adds element with key, true if successful
 // bool insert( const pair<K, V>& pair )    --> Adds pair to hash, true if successful
+// bool try_emplace( const K& k, args... )  --> Adds a value built from args only if k is not in the hash yet
 // void erase( const K& k )                 --> Removes all any (if any) entries with key k
 // void clear( )                            --> Empties the hash
 // int bucket_count()                       --> Returns the number of buckets allocated (size of the hash vector)
@@ -18,16 +24,29 @@
 // int bucket( const K& key )               --> Returns the bucket number of key (or throws std::out_of_range if key not found)
 // float load_factor( )                     --> Returns the load factor of the hash
 // void rehash( int n )                     --> Resizes the hash to contain at least n buckets
-//                                              Resizes to next prime starting from n and going up
+//                                              Resizes to the next size the table's SizePolicy allows
+//                                              (next prime on its ladder, or next power of two) starting from n
+// void reserve( int n )                    --> Grows the hash so n elements fit without a rehash
+// float max_load_factor( )                 --> Returns the load factor past which the hash grows
+// void max_load_factor( float f )          --> Sets it, growing the hash now if it is already above f
 
 
 // void ~Hash( )       --> Destructor
 // Hash( )             --> Basic constructor
 
 //
-//  Hash is an abstract base class for other Hash implementations to inherit from
-//   Expected subclasses include: ChainingHash - uses a vector of lists
-//                                ProbingHash - linear probing on a vector
+//  Hash is the runtime-polymorphic form of the interface. The tables do not
+//  inherit from it; they implement it statically through StaticHash below,
+//  and HashAdapter turns any of them into a Hash<K,V> where a virtual
+//  interface is needed.
+//   Implementations include: ChainingHash - uses a vector of arena-backed chains
+//                            ProbingHash - linear probing on a vector
+//                            SwissHash - group probing over a control byte array
+//                            RobinHoodHash - Robin Hood linear probing with backward-shift deletion
+//                            BucketChainingHash - chains of 64-byte blocks with inline slots
+//                            CuckooHash - bucketized cuckoo hashing with two candidate lines per key
+//                            StringHash - linear probing over std::string keys with cached hashes
+//                            ParallelProbingHash - lock-free linear probing
 //  This interface is based upon, and expects similar behavior to the C++11 STL unordered_map
 //
 template <typename K, typename V>
@@ -69,7 +88,7 @@ public:
 // *************** Private /internal function implementation ******* //
 
 private:
-    virtual int hash(const K& key) = 0;
+    virtual size_t hash(const K& key) = 0;
 
 };
 
@@ -77,5 +96,125 @@ private:
 template <typename K, typename V>
 Hash<K, V>::~Hash() {}
 
+//
+//  StaticHash is the compile-time form of the interface. A table derives
+//  from StaticHash<Table, K, V> (CRTP) and defines the operations listed
+//  above as ordinary members, so nothing is virtual: calls on a concrete
+//  table, down to hash() inside the probe loops, resolve at compile time
+//  and can inline. The members that read the same in every table live here.
+//
+template <typename Derived, typename K, typename V>
+class StaticHash
+{
+public:
+    typedef K key_type;
+    typedef V mapped_type;
+
+    V& operator[](const K& key) {
+        return this->derived().at(key);
+    }
+
+    void insert(const std::pair<K, V>& pair) {
+        this->derived().emplace(pair.first, pair.second);
+    }
+
+    void insert(std::pair<K, V>&& pair) {
+        this->derived().emplace(std::move(pair.first), std::move(pair.second));
+    }
+
+protected:
+    // Tables are never deleted through a StaticHash pointer
+    ~StaticHash() {}
+
+private:
+    Derived& derived() {
+        return static_cast<Derived&>(*this);
+    }
+};
+
+//
+//  constructInPlace() is how the tables put a value into a slot that already
+//  holds a live V (a fresh slot is value-initialized, an erased one keeps
+//  its stale value). The old value is destroyed and V(args...) is built in
+//  its storage, so try_emplace() makes no temporary and emplace() moves its
+//  value in once. If V(args...) throws, the slot is value-initialized
+//  again. If V() can throw too, the value is built aside and move-assigned
+//  instead, so the slot is never left without a value.
+//
+template <typename V, typename... Args>
+void constructInPlace(std::true_type, V& Slot, Args&&... args)
+{
+    Slot.~V();
+    try {
+        ::new((void*)&Slot) V(std::forward<Args>(args)...);
+    }
+    catch(...) {
+        ::new((void*)&Slot) V();
+        throw;
+    }
+}
+
+template <typename V, typename... Args>
+void constructInPlace(std::false_type, V& Slot, Args&&... args)
+{
+    Slot = V(std::forward<Args>(args)...);
+}
+
+template <typename V, typename... Args>
+void constructInPlace(V& Slot, Args&&... args)
+{
+    constructInPlace(std::integral_constant<bool, std::is_nothrow_default_constructible<V>::value>(), Slot, std::forward<Args>(args)...);
+}
+
+//
+//  HashAdapter is a Hash<K,V> view of a table, for code that needs a virtual
+//  interface. It only forwards; the table must outlive the adapter.
+//
+template <typename Table>
+class HashAdapter : public Hash<typename Table::key_type, typename Table::mapped_type>
+{
+private:
+    typedef typename Table::key_type K;
+    typedef typename Table::mapped_type V;
+
+    Table& Impl;
+
+public:
+    explicit HashAdapter(Table& table) : Impl(table) {}
+
+    ~HashAdapter() {}
+
+    bool empty() { return this->Impl.empty(); }
+
+    int size() { return this->Impl.size(); }
+
+    V& at(const K& key) { return this->Impl.at(key); }
+
+    V& operator[](const K& key) { return this->Impl[key]; }
+
+    int count(const K& key) { return this->Impl.count(key); }
+
+    void emplace(K key, V value) { this->Impl.emplace(key, value); }
+
+    void insert(const std::pair<K, V>& pair) { this->Impl.insert(pair); }
+
+    void erase(const K& key) { this->Impl.erase(key); }
+
+    void clear() { this->Impl.clear(); }
+
+    int bucket_count() { return this->Impl.bucket_count(); }
+
+    int bucket_size(int n) { return this->Impl.bucket_size(n); }
+
+    int bucket(const K& key) { return this->Impl.bucket(key); }
+
+    float load_factor() { return this->Impl.load_factor(); }
+
+    void rehash(int n) { this->Impl.rehash(n); }
+
+private:
+    size_t hash(const K& key) { return this->Impl.hash(key); }
+};
+
 
 #endif
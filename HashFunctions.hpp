@@ -0,0 +1,193 @@
+#pragma once
+
+#ifndef __HASH_FUNCTIONS_H
+#define __HASH_FUNCTIONS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <climits>
+#include <algorithm>
+#include <functional>
+#include <type_traits>
+
+#include "StringView.hpp"
+
+//
+// Hash functors and table sizing policies shared by the hash tables
+//
+//  Tables take a Hasher (any functor size_t(const K&)) and a SizePolicy.
+//  The policy decides which table sizes are allowed (size(n) is the
+//  smallest one of at least n), how far a full table grows (grow(n) is the
+//  size after n), and maps a hash onto a home bucket; probing itself only
+//  ever steps and wraps, so with the policies below no lookup executes a
+//  division. When a table grows is up to its max_load_factor().
+//
+//  Both reductions rely on every bit of the hash being well mixed, which is
+//  what MixHash is for: wrap weak hashes (std::hash on integers is the
+//  identity) in it rather than passing them in directly.
+//
+
+// Finalizer from splitmix64: cheap, and every input bit affects every output bit
+inline uint64_t mix64(uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x;
+}
+
+template<typename K, bool Integral = std::is_integral<K>::value || std::is_enum<K>::value>
+struct MixHash {
+    size_t operator()(const K& key) const {
+        return (size_t)mix64((uint64_t)key);
+    }
+};
+
+// Anything else goes through std::hash first
+template<typename K>
+struct MixHash<K, false> {
+    size_t operator()(const K& key) const {
+        return (size_t)mix64((uint64_t)std::hash<K>()(key));
+    }
+};
+
+// n bytes, eight at a time, each word folded in through mix64
+inline uint64_t hashBytes(const char* Data, size_t n) {
+    uint64_t H = (uint64_t)n * 0x9e3779b97f4a7c15ULL;
+    for(; n >= 8; Data += 8, n -= 8) {
+        uint64_t Word;
+        memcpy(&Word, Data, 8);
+        H = mix64(H ^ Word);
+    }
+    uint64_t Tail = 0;
+    if(n > 0)
+        memcpy(&Tail, Data, n);
+    return mix64(H ^ Tail);
+}
+
+// String keys hashed from their bytes, so a std::string and a StringView of
+// the same characters hash alike
+struct BytesHash {
+    size_t operator()(StringView key) const {
+        return (size_t)hashBytes(key.data(), key.size());
+    }
+};
+
+// n * Num / Den, saturating at INT_MAX
+inline int scaleSize(int n, int Num, int Den) {
+    int64_t Scaled = (int64_t)n * Num / Den;
+    return Scaled > INT_MAX ? INT_MAX : (int)Scaled;
+}
+
+// Every prime below 64, then the first prime past each step of 2^(1/8)
+// up to INT_MAX. A template only so the array can be defined in a header.
+template<typename = void>
+struct PrimeLadder {
+    static constexpr int Primes[] = {
+        2, 3, 5, 7, 11, 13, 17, 19,
+        23, 29, 31, 37, 41, 43, 47, 53,
+        59, 61, 67, 71, 79, 83, 97, 101,
+        109, 127, 131, 149, 157, 167, 191, 199,
+        223, 239, 257, 281, 307, 337, 367, 397,
+        431, 479, 521, 563, 613, 673, 727, 797,
+        863, 941, 1031, 1117, 1223, 1361, 1451, 1583,
+        1723, 1879, 2053, 2237, 2437, 2657, 2897, 3163,
+        3449, 3761, 4099, 4481, 4871, 5323, 5801, 6317,
+        6899, 7517, 8209, 8941, 9743, 10627, 11587, 12637,
+        13781, 15031, 16411, 17881, 19489, 21269, 23173, 25301,
+        27581, 30059, 32771, 35747, 38971, 42499, 46349, 50539,
+        55109, 60101, 65537, 71471, 77951, 84991, 92683, 101081,
+        110221, 120199, 131101, 142939, 155887, 169987, 185369, 202183,
+        220447, 240421, 262147, 285871, 311747, 339959, 370759, 404291,
+        440893, 480787, 524309, 571741, 623521, 679919, 741457, 808579,
+        881779, 961549, 1048583, 1143481, 1246997, 1359857, 1482919, 1617137,
+        1763491, 1923107, 2097169, 2286961, 2493949, 2719699, 2965847, 3234251,
+        3526987, 3846197, 4194319, 4573931, 4987901, 5439341, 5931649, 6468509,
+        7053971, 7692389, 8388617, 9147857, 9975803, 10878709, 11863289, 12937007,
+        14107921, 15384821, 16777259, 18295687, 19951597, 21757361, 23726569, 25874027,
+        28215809, 30769567, 33554467, 36591383, 39903197, 43514717, 47453149, 51748043,
+        56431657, 61539113, 67108879, 73182743, 79806341, 87029471, 94906297, 103496027,
+        112863217, 123078209, 134217757, 146365487, 159612679, 174058861, 189812533, 206992043,
+        225726419, 246156401, 268435459, 292730989, 319225391, 348117739, 379625083, 413984099,
+        451452839, 492312797, 536870923, 585461917, 638450719, 696235447, 759250133, 827968151,
+        902905657, 984625687, 1073741827, 1170923777, 1276901429, 1392470869, 1518500279, 1655936281,
+        1805811341, 1969251217, 2147483647
+    };
+};
+
+template<typename T>
+constexpr int PrimeLadder<T>::Primes[];
+
+//
+// Prime table sizes (the default), picked from PrimeLadder by binary search
+// instead of trial division. A full table doubles. The home bucket is
+// Lemire's multiply-shift reduction of the high 32 bits:
+// ((h >> 32) * n) >> 32 lands in [0, n) like h % n would, but costs one
+// multiply instead of a division.
+//
+struct PrimeSize {
+    static int size(int n) {
+        const int* First = PrimeLadder<>::Primes;
+        const int* Last = First + sizeof(PrimeLadder<>::Primes) / sizeof(int);
+        const int* Found = std::lower_bound(First, Last, n);
+        return Found == Last ? Last[-1] : *Found;
+    }
+
+    static int grow(int n) {
+        return size(scaleSize(n, 2, 1));
+    }
+
+    static unsigned index(size_t h, unsigned n) {
+        return (unsigned)(((uint64_t)h >> 32) * (uint64_t)n >> 32);
+    }
+
+    // Any prime, so snapshots saved with sizes off the ladder still load
+    static bool allows(int n) {
+        if(n < 2)
+            return false;
+        for(int i = 2; (int64_t)i * i <= n; i++) {
+            if(n % i == 0)
+                return false;
+        }
+        return true;
+    }
+};
+
+//
+// The prime ladder, growing by half instead of doubling: less memory held
+// after each resize, at the cost of resizing more often.
+//
+struct ThreeHalvesSize : PrimeSize {
+    static int grow(int n) {
+        return size(scaleSize(n, 3, 2));
+    }
+};
+
+//
+// Power-of-two table sizes. A full table doubles, and the home bucket is a
+// mask of the low bits.
+//
+struct PowerOfTwoSize {
+    static int size(int n) {
+        int Size = 1;
+        while(Size < n && Size <= INT_MAX / 2)
+            Size <<= 1;
+        return Size;
+    }
+
+    static int grow(int n) {
+        return size(scaleSize(n, 2, 1));
+    }
+
+    static unsigned index(size_t h, unsigned n) {
+        return (unsigned)h & (n - 1);
+    }
+
+    static bool allows(int n) {
+        return n > 0 && (n & (n - 1)) == 0;
+    }
+};
+
+#endif //__HASH_FUNCTIONS_H
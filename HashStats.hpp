@@ -0,0 +1,162 @@
+#pragma once
+
+#ifndef __HASH_STATS_H
+#define __HASH_STATS_H
+
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <algorithm>
+
+//
+// Instrumentation behind the tables' stats()
+//
+//  stats() always reports what can be read off the table itself: the longest
+//  cluster (run of occupied slots, or longest chain) and the tombstones. The
+//  probe-length histograms and the rehash count and time need counters on the
+//  hot path, and those only exist when the build defines HASH_STATS; without
+//  it every HASH_STATS_ONLY(...) expands to nothing and the tables carry no
+//  counter members at all.
+//
+#ifdef HASH_STATS
+#define HASH_STATS_ONLY(...) __VA_ARGS__
+#else
+#define HASH_STATS_ONLY(...)
+#endif
+
+struct HashStats {
+    HashStats() : MaxCluster(0), Tombstones(0), TombstoneRatio(0), Rehashes(0), RehashSeconds(0) {}
+
+    // Probes[n] is the number of lookups that inspected n slots (n chain
+    // nodes for chaining, n groups for SwissHash, n lines for
+    // BucketChainingHash); the last entry also counts longer probes. While
+    // ProbingHash or ChainingHash rehash incrementally, a lookup that goes on
+    // to the old table is counted once per table. Empty unless built with
+    // HASH_STATS.
+    std::vector<long> HitProbes;
+    std::vector<long> MissProbes;
+    int MaxCluster;
+    int Tombstones;
+    float TombstoneRatio;   // tombstones per bucket
+    long Rehashes;          // full or incremental rehashes started, and in-place purges
+    double RehashSeconds;   // time spent in them, summed over threads
+
+    static double mean(const std::vector<long>& Probes) {
+        long Count = 0;
+        double Sum = 0;
+        for(size_t N = 0; N < Probes.size(); N++) {
+            Count += Probes[N];
+            Sum += (double)N * Probes[N];
+        }
+        return Count == 0 ? 0 : Sum / Count;
+    }
+};
+
+// Hot-path counters; relaxed atomics so ParallelProbingHash can share them
+class StatsCounters {
+public:
+    enum { HISTOGRAM_SIZE = 64 };
+
+    StatsCounters() {
+        this->reset();
+    }
+
+    StatsCounters(const StatsCounters& Other) {
+        this->copy(Other);
+    }
+
+    StatsCounters& operator=(const StatsCounters& Other) {
+        this->copy(Other);
+        return *this;
+    }
+
+    void hit(long unsigned int Probes) {
+        this->Hits[std::min(Probes, (long unsigned int)HISTOGRAM_SIZE - 1)].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void miss(long unsigned int Probes) {
+        this->Misses[std::min(Probes, (long unsigned int)HISTOGRAM_SIZE - 1)].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void rehash() {
+        this->Rehashes.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void reset() {
+        for(int N = 0; N < HISTOGRAM_SIZE; N++) {
+            this->Hits[N].store(0, std::memory_order_relaxed);
+            this->Misses[N].store(0, std::memory_order_relaxed);
+        }
+        this->Rehashes.store(0, std::memory_order_relaxed);
+        this->RehashNanos.store(0, std::memory_order_relaxed);
+    }
+
+    void fill(HashStats& Stats) const {
+        Stats.HitProbes.resize(HISTOGRAM_SIZE);
+        Stats.MissProbes.resize(HISTOGRAM_SIZE);
+        for(int N = 0; N < HISTOGRAM_SIZE; N++) {
+            Stats.HitProbes[N] = this->Hits[N].load(std::memory_order_relaxed);
+            Stats.MissProbes[N] = this->Misses[N].load(std::memory_order_relaxed);
+        }
+        Stats.Rehashes = this->Rehashes.load(std::memory_order_relaxed);
+        Stats.RehashSeconds = this->RehashNanos.load(std::memory_order_relaxed) * 1e-9;
+    }
+
+    // Adds the lifetime of the timer to the rehash time
+    class Timer {
+    private:
+        StatsCounters& Counters;
+        std::chrono::steady_clock::time_point Start;
+
+    public:
+        explicit Timer(StatsCounters& counters) : Counters(counters), Start(std::chrono::steady_clock::now()) {}
+
+        ~Timer() {
+            long Nanos = (long)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - this->Start).count();
+            this->Counters.RehashNanos.fetch_add(Nanos, std::memory_order_relaxed);
+        }
+    };
+
+private:
+    std::atomic<long> Hits[HISTOGRAM_SIZE];
+    std::atomic<long> Misses[HISTOGRAM_SIZE];
+    std::atomic<long> Rehashes;
+    std::atomic<long> RehashNanos;
+
+    void copy(const StatsCounters& Other) {
+        for(int N = 0; N < HISTOGRAM_SIZE; N++) {
+            this->Hits[N].store(Other.Hits[N].load(std::memory_order_relaxed), std::memory_order_relaxed);
+            this->Misses[N].store(Other.Misses[N].load(std::memory_order_relaxed), std::memory_order_relaxed);
+        }
+        this->Rehashes.store(Other.Rehashes.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        this->RehashNanos.store(Other.RehashNanos.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    }
+};
+
+// Longest run of consecutive slots for which Occupied(i) holds in a table of
+// n slots, counting a run that wraps from the end back to the start once
+template<typename OccupiedFunction>
+int longestRun(long unsigned int n, OccupiedFunction Occupied) {
+    long unsigned int Longest = 0;
+    long unsigned int Run = 0;
+    long unsigned int Leading = 0;
+    bool AtStart = true;
+    for(long unsigned int I = 0; I < n; I++) {
+        if(Occupied(I)) {
+            Run += 1;
+            Longest = std::max(Longest, Run);
+        }
+        else {
+            if(AtStart)
+                Leading = Run;
+            AtStart = false;
+            Run = 0;
+        }
+    }
+    if(AtStart)
+        return (int)n;
+    return (int)std::max(Longest, Run + Leading);
+}
+
+#endif //__HASH_STATS_H
@@ -0,0 +1,129 @@
+#pragma once
+
+#ifndef __HUGE_PAGE_ALLOCATOR_H
+#define __HUGE_PAGE_ALLOCATOR_H
+
+#include <new>
+#include <utility>
+#include <cstdlib>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <sys/mman.h>
+
+enum HugePageMode {
+    TRANSPARENT_HUGE_PAGES,
+    EXPLICIT_HUGE_PAGES
+};
+
+//
+// Allocator for large slot arrays
+//
+//  A table of tens of millions of slots spread over 4 KB pages misses the
+//  TLB on almost every probe. Allocations of at least HUGE_PAGE bytes are
+//  mapped anonymously, aligned to a huge page and advised MADV_HUGEPAGE, so
+//  the kernel can back them with transparent huge pages. EXPLICIT_HUGE_PAGES
+//  asks for MAP_HUGETLB first, which needs pages reserved in
+//  /proc/sys/vm/nr_hugepages, and falls back to the transparent path when
+//  none are free. Smaller allocations come from calloc.
+//
+//  Either way the memory starts out zeroed, which the tables' slot storage
+//  (see SlotVector.hpp) relies on to skip value-initializing fresh slots.
+//
+template<typename T, HugePageMode Mode = TRANSPARENT_HUGE_PAGES>
+class HugePageAllocator {
+public:
+    typedef T value_type;
+
+    template<typename U>
+    struct rebind {
+        typedef HugePageAllocator<U, Mode> other;
+    };
+
+    enum { HUGE_PAGE = 2 << 20 };
+
+    HugePageAllocator() {}
+
+    template<typename U>
+    HugePageAllocator(const HugePageAllocator<U, Mode>&) {}
+
+    T* allocate(size_t n) {
+        static_assert(alignof(T) <= alignof(std::max_align_t), "HugePageAllocator does not over-align small allocations");
+        if(n > (size_t)-1 / sizeof(T))
+            throw std::bad_alloc();
+        size_t Bytes = n * sizeof(T);
+        if(Bytes < HUGE_PAGE) {
+            void* P = std::calloc(n == 0 ? 1 : n, sizeof(T));
+            if(P == nullptr)
+                throw std::bad_alloc();
+            return (T*)P;
+        }
+        return (T*)map(roundUp(Bytes));
+    }
+
+    void deallocate(T* p, size_t n) {
+        size_t Bytes = n * sizeof(T);
+        if(Bytes < HUGE_PAGE)
+            std::free(p);
+        else
+            munmap(p, roundUp(Bytes));
+    }
+
+private:
+    static size_t roundUp(size_t Bytes) {
+        return (Bytes + HUGE_PAGE - 1) & ~(size_t)(HUGE_PAGE - 1);
+    }
+
+    static void* map(size_t Length) {
+#ifdef MAP_HUGETLB
+        if(Mode == EXPLICIT_HUGE_PAGES) {
+            void* P = mmap(nullptr, Length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+            if(P != MAP_FAILED)
+                return P;
+        }
+#endif
+        // Map one huge page extra and trim both ends so the range is aligned
+        char* Raw = (char*)mmap(nullptr, Length + HUGE_PAGE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if(Raw == (char*)MAP_FAILED)
+            throw std::bad_alloc();
+        char* Start = (char*)(((uintptr_t)Raw + HUGE_PAGE - 1) & ~(uintptr_t)(HUGE_PAGE - 1));
+        if(Start != Raw)
+            munmap(Raw, Start - Raw);
+        munmap(Start + Length, Raw + HUGE_PAGE - Start);
+#ifdef MADV_HUGEPAGE
+        madvise(Start, Length, MADV_HUGEPAGE);
+#endif
+        return Start;
+    }
+};
+
+template<typename T, typename U, HugePageMode Mode>
+bool operator==(const HugePageAllocator<T, Mode>&, const HugePageAllocator<U, Mode>&) {
+    return true;
+}
+
+template<typename T, typename U, HugePageMode Mode>
+bool operator!=(const HugePageAllocator<T, Mode>&, const HugePageAllocator<U, Mode>&) {
+    return false;
+}
+
+// Whether every allocation from Allocator comes back zero-filled
+template<typename Allocator>
+struct ZeroedAllocation : std::false_type {};
+
+template<typename T, HugePageMode Mode>
+struct ZeroedAllocation<HugePageAllocator<T, Mode>> : std::true_type {};
+
+// Whether all-zero bytes are a value-initialized T. A class that is not
+// trivial can say so with a nonzero enum ZERO_INITIALIZABLE.
+template<typename T, typename = void>
+struct ZeroInitializable : std::integral_constant<bool, std::is_arithmetic<T>::value || std::is_enum<T>::value
+                                                        || std::is_pointer<T>::value || std::is_trivial<T>::value> {};
+
+template<typename T>
+struct ZeroInitializable<T, typename std::enable_if<T::ZERO_INITIALIZABLE != 0>::type> : std::true_type {};
+
+template<typename A, typename B>
+struct ZeroInitializable<std::pair<A, B>> : std::integral_constant<bool, ZeroInitializable<A>::value && ZeroInitializable<B>::value> {};
+
+#endif //__HUGE_PAGE_ALLOCATOR_H
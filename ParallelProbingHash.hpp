@@ -4,225 +4,856 @@
 #define __PARALLEL_PROBING_HASH_H
 
 #include <vector>
+#include <string>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <climits>
+#include <algorithm>
 #include <stdexcept>
+#include <type_traits>
 #include <omp.h>
 
 //#include "Hash.hpp"
+#include "HashFunctions.hpp"
 #include "ProbingHash.hpp"
+#include "BulkBuild.hpp"
+#include "HashStats.hpp"
+#include "Snapshot.hpp"
+#include "WriteBuffer.hpp"
 
 using std::vector;
 using std::pair;
 
-// Can be used for tracking lazy deletion for each element in your table
-//enum EntryState {
-    //EMPTY = 0,
-    //VALID = 1,
-    //DELETED = 2
-//};
-
-template<typename K, typename V>
-class ParallelProbingHash : public Hash<K,V> { // derived from Hash
+//
+// Lock-free linear probing hash table - implements Hash (via StaticHash)
+//
+//  Keys are hashed with Hasher and given a home slot by SizePolicy (see
+//  HashFunctions.hpp), as in ProbingHash, and the table grows the same way:
+//  to SizePolicy::grow() of its size past max_load_factor().
+//
+//  Every slot carries an atomic state word. The low bits hold the EntryState
+//  (plus the transient states below) and the remaining bits are a generation
+//  tag bumped on every claim, so a compare-and-swap can never succeed against
+//  a slot that was recycled in between (ABA). Writers claim EMPTY/DELETED
+//  slots by CAS, readers never take a lock, and the element count is kept in
+//  per-thread shards.
+//
+//  Growing is cooperative: the first writer to cross the load factor links a
+//  bigger array behind the current one, and every writer that arrives while
+//  it is linked claims fixed-size chunks of the old array and moves them over.
+//  A moved slot is sealed, so writers that find one retry in the new array
+//  and readers that miss in the old array continue into the new one. A slot
+//  that was EMPTY is sealed as MOVED_EMPTY, which still ends a probe of the
+//  old array as EMPTY did; moved entries and tombstones become MOVED, which
+//  probes pass over, since the rest of their cluster may not have moved yet.
+//  The thread that finishes the last chunk publishes the new array and
+//  retires the old one.
+//
+//  Retired arrays are reclaimed by epochs. Every operation runs inside an
+//  EpochGuard, which publishes the global epoch in a reservation slot of its
+//  own before it loads the table; retiring an array stamps it with the
+//  epoch and bumps it. An array is freed once every occupied reservation is
+//  newer than its stamp, since no operation can still hold it then. Only
+//  writers (every CHECK_INTERVAL inserts per shard, and after a resize) free
+//  anything, so lookups never wait on a writer and never free memory: they
+//  are wait-free while fewer than NUM_RESERVATIONS threads are inside the
+//  table. A reference from at() or operator[] points into the array it was
+//  found in, so it is only good until that array is reclaimed after a
+//  resize. While writers may be growing the table, read with find(key,
+//  value), which copies the value out before its guard lets the array go.
+//
+//  Each array counts its DELETED tombstones. When an erase pushes them past
+//  a quarter of the slots, it starts the same cooperative resize at the
+//  current size, or at half the size if fewer than an eighth of the slots
+//  are live. Migration never copies tombstones, so the new array starts
+//  clean. An in-place purge like ProbingHash's would have to move live
+//  entries under concurrent readers, so this table always rebuilds.
+//
+//  save() and load_mmap() work as in ProbingHash, and the slot layout is the
+//  same (a 32-bit state word, then the value), so either table can load the
+//  other's snapshots, and both need trivially copyable keys and values.
+//  save() writes plain EntryStates without generation tags. A loaded array
+//  keeps its slots in the mapping until a resize moves them out.
+//
+//  Allocator supplies the slot arrays, as in ProbingHash. An EMPTY slot is
+//  all zero bytes, so with HugePageAllocator a new array is used as mapped.
+//
+template<typename K, typename V, typename Hasher = MixHash<K>, typename SizePolicy = PrimeSize, typename Allocator = std::allocator<V>>
+class ParallelProbingHash : public StaticHash<ParallelProbingHash<K, V, Hasher, SizePolicy, Allocator>, K, V> {
 private:
-    // Needs a table and a size.
-    // Table should be a vector of std::pairs for lazy deletion
-    std::vector<std::pair<EntryState, V>> Table;
-    int numElements;
+    template<typename> friend class HashAdapter;
+
+    enum {
+        CLAIMED = 3,      // a writer owns the slot and is filling in the value
+        MOVED = 4,        // the entry or tombstone was migrated during a resize
+        MIGRATING = 5,    // the value is being copied to the new array but is still readable
+        MOVED_EMPTY = 6,  // an EMPTY slot sealed by a resize; still ends a probe
+        STATE_MASK = 7,
+        GENERATION = 8,
+        NUM_SHARDS = 32,
+        CHECK_INTERVAL = 64,
+        EXACT_CHECK_LIMIT = 1 << 14,
+        CHUNK_SIZE = 1024,
+        SHRINK_LIMIT = 64,
+        NUM_RESERVATIONS = 64
+    };
+
+    enum PlaceResult { PLACED, FULL, SEALED };
+
+    struct Slot {
+        enum { ZERO_INITIALIZABLE = EMPTY == 0 && ZeroInitializable<V>::value };
+        Slot() : State(EMPTY), Value() {}
+        std::atomic<unsigned> State;
+        V Value;
+    };
+
+    struct SlotArray {
+        explicit SlotArray(int n) : Size(n), Next(nullptr), Retired(nullptr), RetiredEpoch(0),
+            Chunks((n + CHUNK_SIZE - 1) / CHUNK_SIZE), ChunksClaimed(0), ChunksDone(0), Tombstones(0) {
+            this->Storage.reset(n);
+            this->Slots = this->Storage.data();
+        }
+        // The slots of a snapshot, left where the mapping put them
+        SlotArray(MappedFile& File, const SnapshotHeader& Header) : Size((int)Header.Capacity),
+            Next(nullptr), Retired(nullptr), RetiredEpoch(0),
+            Chunks((Size + CHUNK_SIZE - 1) / CHUNK_SIZE), ChunksClaimed(0), ChunksDone(0), Tombstones((int)Header.Deleted) {
+            this->Storage.adopt(File, Header.SlotOffset, Header.Capacity);
+            this->Slots = this->Storage.data();
+        }
+        int Size;
+        SlotVector<Slot, Allocator> Storage;
+        Slot* Slots;
+        // Set once when a resize starts and never cleared, so a reader holding
+        // a retired array can always follow it to the newer one
+        std::atomic<SlotArray*> Next;
+        SlotArray* Retired;
+        uint64_t RetiredEpoch;
+        int Chunks;
+        std::atomic<int> ChunksClaimed;
+        std::atomic<int> ChunksDone;
+        std::atomic<int> Tombstones;
+    };
+
+    // One cache line per shard so threads never write each other's counters
+    struct alignas(64) Shard {
+        Shard() : Count(0) {}
+        std::atomic<int> Count;
+    };
+
+    // The epoch an operation entered at, or IDLE
+    struct alignas(64) Reservation {
+        Reservation() : Epoch(IDLE) {}
+        std::atomic<uint64_t> Epoch;
+    };
+
+    static const uint64_t IDLE = ~(uint64_t)0;
+
+    // Holds a reservation for the length of one operation
+    class EpochGuard {
+    private:
+        Reservation& Held;
+
+    public:
+        explicit EpochGuard(ParallelProbingHash& Owner) : Held(Owner.enter()) {}
+
+        ~EpochGuard() {
+            this->Held.Epoch.store(IDLE, std::memory_order_release);
+        }
+    };
+
+    std::atomic<SlotArray*> Table;
+    std::atomic<SlotArray*> RetiredList;
+    std::atomic<uint64_t> Epoch;
+    Reservation Reservations[NUM_RESERVATIONS];
+    Shard Shards[NUM_SHARDS];
+    std::atomic<float> MaxLoad;
+    Hasher HashFunction;
+    HASH_STATS_ONLY(StatsCounters Counters;)
 
 public:
     ParallelProbingHash(int n = 11) {
-        //this->tableSize = n;
-        this->Table.resize(n);
-        this->numElements = 0;
+        this->Table.store(new SlotArray(SizePolicy::size(n)));
+        this->RetiredList.store(nullptr);
+        this->Epoch.store(0);
+        this->MaxLoad.store(.75f);
     }
 
     ~ParallelProbingHash() {
-        // Needs to actually free all table contents
-        //this->tableSize = 0;
-        //this->Table.resize(0);
-        this->clear();
+        delete this->Table.load();
+        this->freeRetired();
     }
 
     bool empty() {
-        for(long unsigned int I = 0; I < this->Table.size(); I++) {
-            if(this->Table[I].first == VALID)
-                return false;
-        }
-        return true;
+        return this->size() == 0;
     }
 
     int size() {
-        return this->numElements;
+        int Size = 0;
+        for(int S = 0; S < NUM_SHARDS; S++)
+            Size += this->Shards[S].Count.load(std::memory_order_relaxed);
+        return Size;
     }
 
     V& at(const K& key) {
-        int Index = this->hash(key);
-        for(long unsigned int I = 0; I < this->Table.size(); I++) {
-            if(this->Table[(Index + I) % this->Table.size()].first == VALID && this->Table[(Index + I) % this->Table.size()].second == key)
-                return this->Table[(Index + I) % this->Table.size()].second;
-        }
-        //throw std::out_of_range("Key not in hash");
+        EpochGuard Guard(*this);
+        Slot* Found = this->find(key, nullptr);
+        if(Found == nullptr)
+            throw std::out_of_range("Key not in hash");
+        return Found->Value;
     }
 
-    V& operator[](const K& key) {
-        int Index = this->hash(key);
-        for(long unsigned int I = 0; I < this->Table.size(); I++) {
-            if(this->Table[(Index + I) % this->Table.size()].first == VALID && this->Table[(Index + I) % this->Table.size()].second == key)
-                return this->Table[(Index + I) % this->Table.size()].second;
+    // Copies the value for key into value and returns true, or returns false
+    // if key is missing. The copy is taken inside the guard and kept only if
+    // the slot did not change meanwhile, so unlike at() the result stays good
+    // however the table is resized or reclaimed afterwards.
+    bool find(const K& key, V& value) {
+        EpochGuard Guard(*this);
+        for(;;) {
+            Slot* Found = this->find(key, nullptr);
+            if(Found == nullptr)
+                return false;
+            unsigned State = Found->State.load(std::memory_order_acquire);
+            if(kind(State) != VALID && kind(State) != MIGRATING)
+                continue;
+            value = Found->Value;
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if(Found->State.load(std::memory_order_relaxed) == State)
+                return true;
         }
-        //throw std::out_of_range("Key not in hash");
     }
 
+    // Exact when no resize is running; during a migration an entry that is
+    // mid-copy is waited for so it is not counted in both arrays
     int count(const K& key) {
+        EpochGuard Guard(*this);
         int Size = 0;
-        int Index = this->hash(key);
-        for(long unsigned int I = 0; I < this->Table.size(); I++) {
-            if(this->Table[(Index + I) % this->Table.size()].first == key)
-                Size += 1;
+        HASH_STATS_ONLY(long unsigned int Probes = 0; long unsigned int First = 0;)
+        for(SlotArray* Array = this->Table.load(std::memory_order_acquire); Array != nullptr; Array = Array->Next.load(std::memory_order_acquire)) {
+            int Index = this->home(key, Array->Size);
+            for(int I = 0; I < Array->Size; I++) {
+                HASH_STATS_ONLY(Probes += 1;)
+                unsigned State = Array->Slots[Index].State.load(std::memory_order_acquire);
+                while(kind(State) == MIGRATING || kind(State) == CLAIMED) {
+                    spin();
+                    State = Array->Slots[Index].State.load(std::memory_order_acquire);
+                }
+                if(ends(State))
+                    break;
+                if(kind(State) == VALID && Array->Slots[Index].Value == key) {
+                    HASH_STATS_ONLY(if(Size == 0) First = Probes;)
+                    Size += 1;
+                }
+                if(++Index == Array->Size)
+                    Index = 0;
+            }
         }
+        // A hit is charged up to its first match, what find() would pay
+        HASH_STATS_ONLY(if(Size > 0) this->Counters.hit(First); else this->Counters.miss(Probes);)
         return Size;
     }
 
     void emplace(K key, V value) {
-        int Index = this->hash(key);
-        for(long unsigned int I = 0; I < this->Table.size(); I++) {
-            if(this->Table[(Index + I) % this->Table.size()].first == EMPTY || this->Table[(Index + I) % this->Table.size()].first == DELETED) {
-                #pragma omp critical 
-                {
-                    this->Table[(Index + I) % this->Table.size()].first = VALID;
-                    this->Table[(Index + I) % this->Table.size()].second = value;
-                    this->numElements += 1;
-                }
-                if(this->load_factor() > .75)
-                    this->rehash();
-                return;
-            }
-        }
+        EpochGuard Guard(*this);
+        this->add(key, std::move(value));
     }
 
-    void insert(const std::pair<K, V>& pair) {
-        int Index = this->hash(pair.first);
-        for(long unsigned int I = 0; I < this->Table.size(); I++) {
-            if(this->Table[(Index + I) % this->Table.size()].first == EMPTY || this->Table[(Index + I) % this->Table.size()].first == DELETED) {
-                #pragma omp critical 
-                {
-                    this->Table[(Index + I) % this->Table.size()].first = VALID;
-                    this->Table[(Index + I) % this->Table.size()].second = pair.second;
-                    this->numElements += 1;
-                }
-                if(this->load_factor() > .75)
-                    this->rehash();
-                return;
-            }
-        }
+    // Inserts V(args...) unless key is already in the table; returns
+    // whether it did. The value is constructed in the slot once one is
+    // claimed, and one const K& takes rvalue keys as well. The lookup and
+    // the insert are separate steps, so two threads racing on the same
+    // missing key can both insert it.
+    template<typename... Args>
+    bool try_emplace(const K& key, Args&&... args) {
+        EpochGuard Guard(*this);
+        if(this->find(key, nullptr) != nullptr)
+            return false;
+        this->add(key, std::forward<Args>(args)...);
+        return true;
+    }
+
+    // Inserts keys[i] -> values[i] for i < n; any number of threads may
+    // insert batches at once, as with emplace
+    void insert_batch(const K* keys, const V* values, size_t n) {
+        EpochGuard Guard(*this);
+        for(size_t I = 0; I < n; I++)
+            this->add(keys[I], values[I]);
     }
 
     void erase(const K& key) {
-        int Index = this->hash(key);
-        for(long unsigned int I = 0; I < this->Table.size(); I++) {
-            if(this->Table[(Index + I) % this->Table.size()].first == VALID && this->Table[(Index + I) % this->Table.size()].second == key) {
-                #pragma omp critical 
-                {
-                    this->Table[(Index + I) % this->Table.size()].first = DELETED;
-                    this->numElements -= 1;
-                }
-            }    
+        EpochGuard Guard(*this);
+        this->remove(key);
+    }
+
+    // Applies a thread's buffered writes (see WriteBuffer.hpp) in order of
+    // home slot in the newest array, so they walk the slots front to back.
+    // The sort is stable, so writes to one key keep their order. Safe to run
+    // concurrently with other operations; reorders writes and moves their
+    // values out.
+    void merge_writes(std::vector<PendingWrite<K, V>>& writes) {
+        EpochGuard Guard(*this);
+        SlotArray* Array = this->Table.load(std::memory_order_acquire);
+        SlotArray* Next = Array->Next.load(std::memory_order_acquire);
+        int Size = (Next != nullptr ? Next : Array)->Size;
+        for(size_t I = 0; I < writes.size(); I++)
+            writes[I].Home = (unsigned)this->home(writes[I].Key, Size);
+        std::stable_sort(writes.begin(), writes.end(), [](const PendingWrite<K, V>& A, const PendingWrite<K, V>& B) { return A.Home < B.Home; });
+        for(size_t I = 0; I < writes.size(); I++) {
+            if(writes[I].Erase)
+                this->remove(writes[I].Key);
+            else
+                this->add(writes[I].Key, std::move(writes[I].Value));
         }
     }
 
+    // Not safe to run concurrently with other operations
     void clear() {
-        this->Table.clear();
+        SlotArray* Array = this->Table.load(std::memory_order_acquire);
+        this->Table.store(new SlotArray(Array->Size), std::memory_order_release);
+        delete Array;
+        this->freeRetired();
+        for(int S = 0; S < NUM_SHARDS; S++)
+            this->Shards[S].Count.store(0, std::memory_order_relaxed);
     }
 
     int bucket_count() {
-        return this->Table.size();
+        EpochGuard Guard(*this);
+        return this->Table.load(std::memory_order_acquire)->Size;
     }
 
     int bucket_size(int n) {
-        if(this->Table[n].first == 1)
+        EpochGuard Guard(*this);
+        if(kind(this->Table.load(std::memory_order_acquire)->Slots[n].State.load(std::memory_order_acquire)) == VALID)
             return 1;
         return 0;
     }
 
     int bucket(const K& key) {
-        int Index = this->hash(key);
-        for(long unsigned int I = 0; I < this->Table.size(); I++) {
-            if(this->Table[(Index + I) % this->Table.size()].first == key) {
-                return (Index + I) % this->Table.size();
-            }    
-        }
-        throw std::out_of_range("Key not in hash");
+        EpochGuard Guard(*this);
+        int Index = 0;
+        if(this->find(key, &Index) == nullptr)
+            throw std::out_of_range("Key not in hash");
+        return Index;
     }
 
     float load_factor() {
-        return (float)this->numElements / (float)this->Table.size();
+        return (float)this->size() / (float)this->bucket_count();
     }
 
-    
     void rehash() {
-        #pragma omp critical 
-        {
-            int nSize = this->findNextPrime(2 * this->Table.size());
-            std::vector<std::pair<EntryState, V>> nTable;
-            nTable.resize(nSize);
-            for(long unsigned int I = 0; I < this->Table.size(); I++) {
-                if(this->Table[I].first == VALID) {
-                    int Index = this->hash(this->Table[I].second);
-                    long unsigned int L = 0;
-                    for(L = 0; nTable[(Index + L) % nSize].first != EMPTY && nTable[(Index + L) % nSize].first != DELETED; L++) {}
-                    nTable[(Index + L) % nSize].first = VALID;
-                    nTable[(Index + L) % nSize].second = this->Table[I].second;
+        this->resize(0);
+    }
+
+    void rehash(int n) {
+        this->resize(SizePolicy::size(n));
+    }
+
+    float max_load_factor() {
+        return this->MaxLoad.load(std::memory_order_relaxed);
+    }
+
+    // As in ProbingHash, f stays below 1 and the table grows right away if
+    // it is already above f
+    void max_load_factor(float f) {
+        if(!(f > 0 && f < 1))
+            throw std::invalid_argument("Max load factor must be between 0 and 1");
+        this->MaxLoad.store(f, std::memory_order_relaxed);
+        this->reserve(this->size());
+    }
+
+    // Makes room for n elements, so inserting up to n never rehashes
+    void reserve(int n) {
+        if(n > (double)this->max_load_factor() * this->bucket_count())
+            this->rehash((int)(n / (double)this->max_load_factor()) + 1);
+    }
+
+    // Bulk load, as in ProbingHash: the table is sized for n more elements
+    // once, data is radix-partitioned by home slot, and each partition fills
+    // its own slot range without any CAS. Not safe to run concurrently with
+    // other operations.
+    void build_from(const std::pair<K, V>* data, size_t n, int threads) {
+        int Needed = (int)((this->size() + n) / (double)this->max_load_factor()) + 1;
+        if(this->bucket_count() < Needed)
+            this->resize(SizePolicy::size(Needed));
+        if(threads < 1)
+            threads = 1;
+        SlotArray* Array = this->Table.load(std::memory_order_acquire);
+        int Size = Array->Size;
+        std::vector<std::pair<long unsigned int, size_t>> Order;
+        std::vector<size_t> Offsets;
+        partitionByHome(n, Size, threads, [&](size_t I) { return (long unsigned int)this->home(data[I].first, Size); }, Order, Offsets);
+
+        std::vector<std::vector<size_t>> Spills(threads);
+        int Reused = 0;
+        #pragma omp parallel for schedule(dynamic) num_threads(threads) reduction(+:Reused)
+        for(int P = 0; P < threads; P++) {
+            int End = (int)(((uint64_t)(P + 1) * Size + threads - 1) / threads);
+            for(size_t I = Offsets[P]; I < Offsets[P + 1]; I++) {
+                int Index = (int)Order[I].first;
+                while(Index < End && kind(Array->Slots[Index].State.load(std::memory_order_relaxed)) == VALID)
+                    Index++;
+                if(Index == End) {
+                    Spills[P].push_back(Order[I].second);
+                    continue;
                 }
+                Slot& S = Array->Slots[Index];
+                unsigned State = S.State.load(std::memory_order_relaxed);
+                if(kind(State) == DELETED)
+                    Reused += 1;
+                S.Value = data[Order[I].second].second;
+                S.State.store(((State & ~STATE_MASK) + GENERATION) | VALID, std::memory_order_relaxed);
             }
-            this->Table = nTable;
         }
+        for(int P = 0; P < threads; P++) {
+            for(size_t I = 0; I < Spills[P].size(); I++)
+                this->place(Array, data[Spills[P][I]].first, data[Spills[P][I]].second);
+        }
+        // place() already took the spilled entries' tombstones off the count
+        Array->Tombstones.fetch_sub(Reused, std::memory_order_relaxed);
+        this->shard().Count.fetch_add((int)n, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
     }
-        
-    void rehash(int n) {
-        #pragma omp critical 
-        {
-            int nSize = this->findNextPrime(n);
-            std::vector<std::pair<EntryState, V>> nTable;
-            nTable.resize(nSize);
-            for(long unsigned int I = 0; I < this->Table.size(); I++) {
-                if(this->Table[I].first == VALID) {
-                    int Index = this->hash(this->Table[I].second);
-                    long unsigned int L = 0;
-                    for(L = 0; nTable[(Index + L) % nSize].first != EMPTY && nTable[(Index + L) % nSize].first != DELETED; L++) {}
-                    nTable[(Index + L) % nSize].first = VALID;
-                    nTable[(Index + L) % nSize].second = this->Table[I].second;
-                }
+
+    // Smallest table that holds the current elements under the load factor.
+    // The old array is freed with the other retired ones.
+    void shrink_to_fit() {
+        this->resize(SizePolicy::size((int)(this->size() / (double)this->max_load_factor()) + 1));
+    }
+
+    // Longest run of non-EMPTY slots and the tombstone share of the current
+    // array, plus the probe histograms and rehash counters when built with
+    // HASH_STATS. A snapshot: concurrent writers may change it as it is read.
+    HashStats stats() {
+        EpochGuard Guard(*this);
+        SlotArray* Array = this->Table.load(std::memory_order_acquire);
+        HashStats Stats;
+        Stats.MaxCluster = longestRun(Array->Size, [&](long unsigned int I) { return !ends(Array->Slots[I].State.load(std::memory_order_relaxed)); });
+        Stats.Tombstones = Array->Tombstones.load(std::memory_order_relaxed);
+        Stats.TombstoneRatio = (float)Stats.Tombstones / (float)Array->Size;
+        HASH_STATS_ONLY(this->Counters.fill(Stats);)
+        return Stats;
+    }
+
+    // Writes the current array to a snapshot file once any running resize
+    // has finished. Not safe to run concurrently with writers.
+    void save(const std::string& path) {
+        static_assert(std::is_trivially_copyable<K>::value && std::is_trivially_copyable<V>::value,
+                      "Snapshots store raw bytes, so keys and values must be trivially copyable");
+        EpochGuard Guard(*this);
+        SlotArray* Array = this->Table.load(std::memory_order_acquire);
+        while(Array->Next.load(std::memory_order_acquire) != nullptr) {
+            this->migrate(Array);
+            while(this->Table.load(std::memory_order_acquire) == Array)
+                spin();
+            Array = this->Table.load(std::memory_order_acquire);
+        }
+        SnapshotHeader Header = snapshotHeader(sizeof(Slot), valueOffset(), Array->Size, this->size(), Array->Tombstones.load(std::memory_order_relaxed));
+        for(int I = 0; I < Array->Size; I++) {
+            if(kind(Array->Slots[I].State.load(std::memory_order_acquire)) == VALID) {
+                Header.CheckSlot = I;
+                Header.HashCheck = this->hash(Array->Slots[I].Value);
+                Header.HomeCheck = this->home(Array->Slots[I].Value, Array->Size);
+                break;
+            }
+        }
+        SnapshotWriter Out(path, Header);
+        std::unique_ptr<Slot[]> Buffer(new Slot[CHUNK_SIZE]);
+        for(int Start = 0; Start < Array->Size; Start += CHUNK_SIZE) {
+            int Count = std::min((int)CHUNK_SIZE, Array->Size - Start);
+            for(int I = 0; I < Count; I++) {
+                Slot& S = Array->Slots[Start + I];
+                Buffer[I].State.store(kind(S.State.load(std::memory_order_acquire)), std::memory_order_relaxed);
+                Buffer[I].Value = S.Value;
             }
-            this->Table = nTable;
+            Out.write(Buffer.get(), Count * sizeof(Slot));
         }
+        Out.finish();
+    }
+
+    // Replaces the contents with a snapshot from save() (of either table),
+    // mapped in place as in ProbingHash. Not safe to run concurrently with
+    // other operations.
+    void load_mmap(const std::string& path) {
+        static_assert(std::is_trivially_copyable<K>::value && std::is_trivially_copyable<V>::value,
+                      "Snapshots store raw bytes, so keys and values must be trivially copyable");
+        MappedFile File;
+        File.open(path);
+        const SnapshotHeader& Header = File.header(snapshotHeader(sizeof(Slot), valueOffset(), 0, 0, 0));
+        if(Header.Capacity > INT_MAX || !SizePolicy::allows((int)Header.Capacity))
+            throw std::runtime_error("Snapshot was written with a different size policy");
+        if(Header.Size > Header.Capacity || Header.Deleted > Header.Capacity - Header.Size)
+            throw std::runtime_error("Snapshot counts do not fit its capacity");
+        int Capacity = (int)Header.Capacity;
+        Slot* Slots = (Slot*)(File.data() + Header.SlotOffset);
+        if(Header.CheckSlot < Header.Capacity && (this->hash(Slots[Header.CheckSlot].Value) != Header.HashCheck
+                                                  || (uint64_t)this->home(Slots[Header.CheckSlot].Value, Capacity) != Header.HomeCheck))
+            throw std::runtime_error("Snapshot was written with a different hash");
+        int Size = (int)Header.Size;
+        SlotArray* Array = this->Table.load(std::memory_order_acquire);
+        this->Table.store(new SlotArray(File, Header), std::memory_order_release);
+        delete Array;
+        this->freeRetired();
+        for(int S = 0; S < NUM_SHARDS; S++)
+            this->Shards[S].Count.store(0, std::memory_order_relaxed);
+        this->Shards[0].Count.store(Size, std::memory_order_relaxed);
     }
 
 private:
-    int findNextPrime(int n)
-    {
-        while (!isPrime(n))
-        {
-            n++;
+    static unsigned kind(unsigned State) {
+        return State & STATE_MASK;
+    }
+
+    // Whether a probe of this array stops here; a miss then goes on to Next
+    static bool ends(unsigned State) {
+        return kind(State) == EMPTY || kind(State) == MOVED_EMPTY;
+    }
+
+    static void spin() {
+        std::this_thread::yield();
+    }
+
+    Shard& shard() {
+        return this->Shards[omp_get_thread_num() % NUM_SHARDS];
+    }
+
+    int home(const K& key, int Size) {
+        return SizePolicy::index(this->hash(key), Size);
+    }
+
+    static uint32_t valueOffset() {
+        Slot S;
+        return (uint32_t)((char*)&S.Value - (char*)&S);
+    }
+
+    // Seqlock-style read: the value only counts if the state word did not
+    // change while we were comparing it. A MIGRATING slot still holds its
+    // value; a MOVED_EMPTY one sends us on to the next array after this one.
+    Slot* find(const K& key, int* Bucket) {
+        HASH_STATS_ONLY(long unsigned int Probes = 0;)
+        for(SlotArray* Array = this->Table.load(std::memory_order_acquire); Array != nullptr; Array = Array->Next.load(std::memory_order_acquire)) {
+            int Index = this->home(key, Array->Size);
+            for(int I = 0; I < Array->Size; I++) {
+                HASH_STATS_ONLY(Probes += 1;)
+                Slot& S = Array->Slots[Index];
+                unsigned State = S.State.load(std::memory_order_acquire);
+                if(ends(State))
+                    break;
+                if((kind(State) == VALID || kind(State) == MIGRATING) && S.Value == key) {
+                    std::atomic_thread_fence(std::memory_order_acquire);
+                    if(S.State.load(std::memory_order_relaxed) == State) {
+                        if(Bucket != nullptr)
+                            *Bucket = Index;
+                        HASH_STATS_ONLY(this->Counters.hit(Probes);)
+                        return &S;
+                    }
+                }
+                if(++Index == Array->Size)
+                    Index = 0;
+            }
         }
-        return n;
+        HASH_STATS_ONLY(this->Counters.miss(Probes);)
+        return nullptr;
     }
 
-    int isPrime(int n)
-    {
-        for (int i = 2; i <= sqrt(n); i++)
+    // Claims a free slot in Array and constructs V(args...) in it. Stops
+    // with SEALED as soon as it meets a slot that a resize has already taken
+    // over. args are only used once a slot is claimed, so a caller can retry
+    // with the same args after FULL or SEALED. If the constructor throws,
+    // the slot goes back to what it was.
+    template<typename... Args>
+    PlaceResult place(SlotArray* Array, const K& key, Args&&... args) {
+        int Index = this->home(key, Array->Size);
+        for(int I = 0; I < Array->Size; I++) {
+            Slot& S = Array->Slots[Index];
+            unsigned State = S.State.load(std::memory_order_relaxed);
+            for(;;) {
+                if(kind(State) == MOVED || kind(State) == MIGRATING || kind(State) == MOVED_EMPTY)
+                    return SEALED;
+                if(kind(State) != EMPTY && kind(State) != DELETED)
+                    break;
+                unsigned Claimed = ((State & ~STATE_MASK) + GENERATION) | CLAIMED;
+                if(S.State.compare_exchange_weak(State, Claimed, std::memory_order_acquire, std::memory_order_relaxed)) {
+                    if(kind(State) == DELETED)
+                        Array->Tombstones.fetch_sub(1, std::memory_order_relaxed);
+                    try {
+                        constructInPlace(S.Value, std::forward<Args>(args)...);
+                    }
+                    catch(...) {
+                        if(kind(State) == DELETED)
+                            Array->Tombstones.fetch_add(1, std::memory_order_relaxed);
+                        S.State.store((Claimed & ~STATE_MASK) | kind(State), std::memory_order_release);
+                        throw;
+                    }
+                    S.State.store((Claimed & ~STATE_MASK) | VALID, std::memory_order_release);
+                    return PLACED;
+                }
+            }
+            if(++Index == Array->Size)
+                Index = 0;
+        }
+        return FULL;
+    }
+
+    template<typename... Args>
+    void add(const K& key, Args&&... args) {
+        Shard& Mine = this->shard();
+        for(;;) {
+            SlotArray* Array = this->Table.load(std::memory_order_acquire);
+            SlotArray* Next = Array->Next.load(std::memory_order_acquire);
+            if(Next != nullptr) {
+                // A resize is running: help move the old array, then write to
+                // the new one. If the last chunks are slow to finish, the new
+                // array must not fill up before it can grow in turn.
+                this->migrate(Array);
+                if(this->size() > this->max_load_factor() * Next->Size) {
+                    while(this->Table.load(std::memory_order_acquire) == Array)
+                        spin();
+                    continue;
+                }
+                Array = Next;
+            }
+
+            PlaceResult Result = this->place(Array, key, std::forward<Args>(args)...);
+            if(Result == SEALED)
+                continue;
+            if(Result == FULL) {
+                // Every slot was taken by concurrent writers before the load
+                // check caught up. An array that is still being filled by a
+                // migration must not start its own, so wait for it to go live.
+                if(Next != nullptr) {
+                    while(this->Table.load(std::memory_order_acquire) != Next)
+                        spin();
+                }
+                this->grow(Array, 0);
+                continue;
+            }
+
+            int Local = Mine.Count.fetch_add(1, std::memory_order_relaxed) + 1;
+            // Summing the shards touches every writer's cache line, so large
+            // tables only do it every CHECK_INTERVAL inserts per shard
+            if(Next == nullptr && (Array->Size < EXACT_CHECK_LIMIT || Local % CHECK_INTERVAL == 0)) {
+                if(this->size() > this->max_load_factor() * Array->Size)
+                    this->grow(Array, 0);
+            }
+            if(Local % CHECK_INTERVAL == 0 && this->RetiredList.load(std::memory_order_relaxed) != nullptr)
+                this->reclaim();
+            return;
+        }
+    }
+
+    // Starts moving Array into a new array of nSize slots (SizePolicy::grow() when 0),
+    // or joins the resize another thread already started on it. Only one
+    // thread can link a new array, so threads that raced on the load factor
+    // check do not grow the table twice.
+    void grow(SlotArray* Array, int nSize) {
+        if(Array->Next.load(std::memory_order_acquire) == nullptr) {
+            if(nSize <= 0)
+                nSize = SizePolicy::grow(Array->Size);
+            SlotArray* Expected = nullptr;
+            SlotArray* nTable = new SlotArray(nSize);
+            if(Array->Next.compare_exchange_strong(Expected, nTable, std::memory_order_acq_rel)) {
+                HASH_STATS_ONLY(this->Counters.rehash();)
+            }
+            else {
+                delete nTable;
+            }
+        }
+        this->migrate(Array);
+    }
+
+    // Size to rebuild a tombstone-heavy array at: halved when it is mostly
+    // empty, otherwise unchanged
+    int cleanSize(SlotArray* Array) {
+        if(Array->Size > SHRINK_LIMIT && this->size() < std::min(.125f, this->max_load_factor() / 4) * Array->Size)
+            return SizePolicy::size(Array->Size / 2);
+        return Array->Size;
+    }
+
+    // Explicit rehash: wait out any running resize, then start a new one from
+    // the current array and see it through
+    void resize(int nSize) {
+        int Minimum = (int)(this->size() / (double)this->max_load_factor()) + 1;
+        if(nSize != 0 && nSize < Minimum)
+            nSize = SizePolicy::size(Minimum);
         {
-            if (n % i == 0)
-            {
-                return false;
+            EpochGuard Guard(*this);
+            for(;;) {
+                SlotArray* Array = this->Table.load(std::memory_order_acquire);
+                if(Array->Next.load(std::memory_order_acquire) != nullptr) {
+                    this->migrate(Array);
+                    continue;
+                }
+                this->grow(Array, nSize);
+                while(this->Table.load(std::memory_order_acquire) == Array)
+                    spin();
+                break;
             }
         }
+        this->reclaim();
+    }
 
-        return true;
+    // Claims chunks of Array until none are left. Chunks are disjoint, so any
+    // number of threads can help at once; whoever completes the last chunk
+    // publishes the new array.
+    void migrate(SlotArray* Array) {
+        HASH_STATS_ONLY(StatsCounters::Timer RehashTimer(this->Counters);)
+        SlotArray* Next = Array->Next.load(std::memory_order_acquire);
+        for(;;) {
+            int Chunk = Array->ChunksClaimed.fetch_add(1, std::memory_order_relaxed);
+            if(Chunk >= Array->Chunks)
+                return;
+            int End = std::min(Array->Size, (Chunk + 1) * CHUNK_SIZE);
+            for(int I = Chunk * CHUNK_SIZE; I < End; I++)
+                this->migrateSlot(Array->Slots[I], Next);
+            if(Array->ChunksDone.fetch_add(1, std::memory_order_acq_rel) + 1 == Array->Chunks) {
+                this->Table.store(Next, std::memory_order_release);
+                this->retire(Array);
+            }
+        }
+    }
+
+    void migrateSlot(Slot& S, SlotArray* Next) {
+        unsigned State = S.State.load(std::memory_order_acquire);
+        for(;;) {
+            if(kind(State) == EMPTY || kind(State) == DELETED) {
+                // Nothing can be inserted past an EMPTY slot any more, so it
+                // may still end probes; a tombstone may have live entries
+                // after it that are not migrated yet
+                unsigned Sealed = kind(State) == EMPTY ? MOVED_EMPTY : MOVED;
+                if(S.State.compare_exchange_weak(State, (State & ~STATE_MASK) | Sealed, std::memory_order_acq_rel, std::memory_order_acquire))
+                    return;
+            }
+            else if(kind(State) == VALID) {
+                unsigned Migrating = (State & ~STATE_MASK) | MIGRATING;
+                if(S.State.compare_exchange_weak(State, Migrating, std::memory_order_acq_rel, std::memory_order_acquire)) {
+                    // Next is not allowed to fill up or grow until this
+                    // migration is published, so the first place() should
+                    // always succeed. If Next was sealed anyway, the entry
+                    // follows it to the newer array rather than being dropped.
+                    // The value is copied, not moved: readers still use it
+                    // while the slot is MIGRATING.
+                    for(SlotArray* Target = Next;;) {
+                        PlaceResult Result = this->place(Target, S.Value, S.Value);
+                        if(Result == PLACED)
+                            break;
+                        Target = Target->Next.load(std::memory_order_acquire);
+                        if(Result == FULL || Target == nullptr)
+                            throw std::logic_error("Migration target filled up before it was published");
+                    }
+                    S.State.store((State & ~STATE_MASK) | MOVED, std::memory_order_release);
+                    return;
+                }
+            }
+            else {
+                // CLAIMED: the writer is about to publish its value
+                spin();
+                State = S.State.load(std::memory_order_acquire);
+            }
+        }
+    }
+
+    // Erases every entry for key
+    void remove(const K& key) {
+        Shard& Mine = this->shard();
+        SlotArray* Dirty = nullptr;
+        for(SlotArray* Array = this->Table.load(std::memory_order_acquire); Array != nullptr; Array = Array->Next.load(std::memory_order_acquire)) {
+            int Index = this->home(key, Array->Size);
+            for(int I = 0; I < Array->Size; I++) {
+                Slot& S = Array->Slots[Index];
+                unsigned State = S.State.load(std::memory_order_acquire);
+                if(ends(State))
+                    break;
+                // A failed CAS means the slot changed under us; look at it again.
+                // An entry being migrated is erased from the new array instead.
+                while((kind(State) == MIGRATING || kind(State) == VALID) && S.Value == key) {
+                    if(kind(State) == MIGRATING) {
+                        spin();
+                        State = S.State.load(std::memory_order_acquire);
+                    }
+                    else if(S.State.compare_exchange_weak(State, (State & ~STATE_MASK) | DELETED, std::memory_order_acq_rel, std::memory_order_acquire)) {
+                        Mine.Count.fetch_sub(1, std::memory_order_relaxed);
+                        if((Array->Tombstones.fetch_add(1, std::memory_order_relaxed) + 1) * 4 > Array->Size)
+                            Dirty = Array;
+                        break;
+                    }
+                }
+                if(++Index == Array->Size)
+                    Index = 0;
+            }
+        }
+        // Only the live array may start a rebuild. Older ones are already on
+        // their way out, and an array a migration is still filling must not
+        // link one of its own (see add())
+        if(Dirty != nullptr && Dirty == this->Table.load(std::memory_order_acquire) && Dirty->Next.load(std::memory_order_acquire) == nullptr)
+            this->grow(Dirty, this->cleanSize(Dirty));
+    }
+
+    // Takes a free reservation, starting from this thread's own slot, and
+    // publishes the current epoch in it before the caller loads the table
+    Reservation& enter() {
+        static std::atomic<unsigned> Threads(0);
+        static thread_local unsigned Hint = Threads.fetch_add(1, std::memory_order_relaxed);
+        for(unsigned I = Hint;; I++) {
+            Reservation& R = this->Reservations[I % NUM_RESERVATIONS];
+            uint64_t Idle = IDLE;
+            if(R.Epoch.load(std::memory_order_relaxed) == IDLE
+               && R.Epoch.compare_exchange_strong(Idle, this->Epoch.load(std::memory_order_acquire), std::memory_order_relaxed)) {
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                return R;
+            }
+            // Every slot is taken: more threads than reservations are inside
+            if((I - Hint) % NUM_RESERVATIONS == NUM_RESERVATIONS - 1)
+                spin();
+        }
     }
 
-    int hash(const K& key) {
-        return (int)key;       
+    // Readers may still be walking a retired array. Stamping it with the
+    // epoch after the new array went live means any operation that entered
+    // later can only have seen the new one.
+    void retire(SlotArray* Array) {
+        Array->RetiredEpoch = this->Epoch.fetch_add(1, std::memory_order_seq_cst);
+        this->pushRetired(Array);
     }
-    
+
+    void pushRetired(SlotArray* Array) {
+        Array->Retired = this->RetiredList.load(std::memory_order_relaxed);
+        while(!this->RetiredList.compare_exchange_weak(Array->Retired, Array, std::memory_order_release, std::memory_order_relaxed)) {}
+    }
+
+    // Frees the retired arrays every operation has moved past and puts the
+    // rest back. Concurrent callers find the list empty and return.
+    void reclaim() {
+        SlotArray* Array = this->RetiredList.exchange(nullptr, std::memory_order_acquire);
+        if(Array == nullptr)
+            return;
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        uint64_t Oldest = IDLE;
+        for(int R = 0; R < NUM_RESERVATIONS; R++)
+            Oldest = std::min(Oldest, this->Reservations[R].Epoch.load(std::memory_order_acquire));
+        while(Array != nullptr) {
+            SlotArray* Retired = Array->Retired;
+            if(Array->RetiredEpoch < Oldest)
+                delete Array;
+            else
+                this->pushRetired(Array);
+            Array = Retired;
+        }
+    }
+
+    void freeRetired() {
+        SlotArray* Array = this->RetiredList.exchange(nullptr, std::memory_order_acquire);
+        while(Array != nullptr) {
+            SlotArray* Retired = Array->Retired;
+            delete Array;
+            Array = Retired;
+        }
+    }
+
+
+    size_t hash(const K& key) {
+        return this->HashFunction(key);
+    }
+
 };
 
 #endif //__PARALLEL_PROBING_HASH_H
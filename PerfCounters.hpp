@@ -0,0 +1,211 @@
+#pragma once
+
+#ifndef __PERF_COUNTERS_H
+#define __PERF_COUNTERS_H
+
+#include <vector>
+#include <string>
+#include <sstream>
+#include <iomanip>
+#include <cstring>
+#include <cerrno>
+#include <cstdint>
+#include <omp.h>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+//
+// Hardware performance counters around a measured phase (Linux perf_event_open)
+//
+//  Counters are per thread in Linux, so the constructor opens one set in each
+//  thread of an OpenMP team of the given size (thread 0 is the caller). The
+//  runtime keeps those threads for later teams of the same size, so the
+//  counters follow the work of every later parallel region with that many
+//  threads; threads it creates for a larger team are not counted. Only user
+//  space is counted, which is all perf_event_paranoid = 2 allows.
+//
+//  start() and stop() read every counter and keep the difference, scaled up
+//  by enabled/running time if the kernel had to multiplex them. An event the
+//  kernel or the CPU does not offer (no PMU in a VM or container, a stricter
+//  paranoid setting, a CPU without the cache event) reads as unavailable and
+//  the others still report; if none opens, report() says why.
+//
+class PerfCounters {
+public:
+    enum Event { CYCLES, INSTRUCTIONS, L1D_MISSES, LLC_MISSES, BRANCH_MISSES, NUM_EVENTS };
+
+    explicit PerfCounters(int threads = 1) : Threads(threads < 1 ? 1 : threads), Open(0) {
+        this->Fds.assign(this->Threads * NUM_EVENTS, -1);
+        this->Before.assign(this->Threads * NUM_EVENTS, Reading());
+        for(int E = 0; E < NUM_EVENTS; E++)
+            this->Counts[E] = -1;
+        #pragma omp parallel num_threads(this->Threads)
+        {
+            int Thread = omp_get_thread_num();
+            for(int E = 0; E < NUM_EVENTS; E++)
+                this->Fds[Thread * NUM_EVENTS + E] = this->open((Event)E);
+        }
+        // An event only counts if every thread has it
+        for(int E = 0; E < NUM_EVENTS; E++) {
+            bool All = true;
+            for(int T = 0; T < this->Threads; T++)
+                All = All && this->Fds[T * NUM_EVENTS + E] >= 0;
+            if(All)
+                this->Open |= 1 << E;
+        }
+    }
+
+    // The counters own their file descriptors, so they cannot be copied
+    PerfCounters(const PerfCounters&) = delete;
+    PerfCounters& operator=(const PerfCounters&) = delete;
+
+    ~PerfCounters() {
+#ifdef __linux__
+        for(size_t I = 0; I < this->Fds.size(); I++) {
+            if(this->Fds[I] >= 0)
+                close(this->Fds[I]);
+        }
+#endif
+    }
+
+    bool available() const {
+        return this->Open != 0;
+    }
+
+    bool available(Event E) const {
+        return (this->Open & (1 << E)) != 0;
+    }
+
+    void start() {
+        for(size_t I = 0; I < this->Fds.size(); I++)
+            this->Before[I] = this->read(this->Fds[I]);
+    }
+
+    void stop() {
+        for(int E = 0; E < NUM_EVENTS; E++)
+            this->Counts[E] = this->available((Event)E) ? 0 : -1;
+        for(int T = 0; T < this->Threads; T++) {
+            for(int E = 0; E < NUM_EVENTS; E++) {
+                if(!this->available((Event)E))
+                    continue;
+                int I = T * NUM_EVENTS + E;
+                Reading After = this->read(this->Fds[I]);
+                uint64_t Running = After.Running - this->Before[I].Running;
+                uint64_t Enabled = After.Enabled - this->Before[I].Enabled;
+                double Value = (double)(After.Value - this->Before[I].Value);
+                if(Running > 0 && Running < Enabled)
+                    Value *= (double)Enabled / (double)Running;
+                this->Counts[E] += (long long)Value;
+            }
+        }
+    }
+
+    // Count between the last start() and stop(), or -1 if unavailable
+    long long count(Event E) const {
+        return this->Counts[E];
+    }
+
+    static const char* name(Event E) {
+        static const char* Names[NUM_EVENTS] = { "cycles", "instructions", "L1D misses", "LLC misses", "branch misses" };
+        return Names[E];
+    }
+
+    // Short column names for CSV and JSON
+    static const char* key(Event E) {
+        static const char* Keys[NUM_EVENTS] = { "cycles", "instructions", "l1d_misses", "llc_misses", "branch_misses" };
+        return Keys[E];
+    }
+
+    // One line with every count divided by Ops
+    std::string report(long Ops) const {
+        std::ostringstream Out;
+        if(!this->available()) {
+            Out << "counters unavailable (" << this->Error << ")";
+            return Out.str();
+        }
+        Out << std::fixed << std::setprecision(2);
+        for(int E = 0; E < NUM_EVENTS; E++) {
+            if(E > 0)
+                Out << "  ";
+            Out << name((Event)E) << " ";
+            if(this->Counts[E] < 0)
+                Out << "n/a";
+            else
+                Out << (double)this->Counts[E] / Ops << "/op";
+        }
+        if(this->Counts[CYCLES] > 0 && this->Counts[INSTRUCTIONS] >= 0)
+            Out << "  IPC " << (double)this->Counts[INSTRUCTIONS] / this->Counts[CYCLES];
+        return Out.str();
+    }
+
+private:
+    struct Reading {
+        Reading() : Value(0), Enabled(0), Running(0) {}
+        uint64_t Value;
+        uint64_t Enabled;
+        uint64_t Running;
+    };
+
+    int Threads;
+    int Open;       // bit E set when event E is open in every thread
+    std::vector<int> Fds;
+    std::vector<Reading> Before;
+    long long Counts[NUM_EVENTS];
+    std::string Error;
+
+    // Counter for the calling thread, or -1
+    int open(Event E) {
+#ifdef __linux__
+        perf_event_attr Attr;
+        memset(&Attr, 0, sizeof(Attr));
+        Attr.size = sizeof(Attr);
+        Attr.type = PERF_TYPE_HARDWARE;
+        switch(E) {
+        case CYCLES:        Attr.config = PERF_COUNT_HW_CPU_CYCLES; break;
+        case INSTRUCTIONS:  Attr.config = PERF_COUNT_HW_INSTRUCTIONS; break;
+        case LLC_MISSES:    Attr.config = PERF_COUNT_HW_CACHE_MISSES; break;
+        case BRANCH_MISSES: Attr.config = PERF_COUNT_HW_BRANCH_MISSES; break;
+        default:
+            Attr.type = PERF_TYPE_HW_CACHE;
+            Attr.config = PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+            break;
+        }
+        Attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        Attr.exclude_kernel = 1;
+        Attr.exclude_hv = 1;
+        int Fd = (int)syscall(__NR_perf_event_open, &Attr, 0, -1, -1, 0);
+        if(Fd < 0) {
+            #pragma omp critical(PerfCountersError)
+            if(this->Error.empty())
+                this->Error = std::string("perf_event_open: ") + strerror(errno);
+        }
+        return Fd;
+#else
+        (void)E;
+        #pragma omp critical(PerfCountersError)
+        this->Error = "perf_event_open needs Linux";
+        return -1;
+#endif
+    }
+
+    static Reading read(int Fd) {
+        Reading R;
+#ifdef __linux__
+        uint64_t Values[3];
+        if(Fd >= 0 && ::read(Fd, Values, sizeof(Values)) == (ssize_t)sizeof(Values)) {
+            R.Value = Values[0];
+            R.Enabled = Values[1];
+            R.Running = Values[2];
+        }
+#else
+        (void)Fd;
+#endif
+        return R;
+    }
+};
+
+#endif //__PERF_COUNTERS_H
@@ -4,48 +4,101 @@
 #define __PROBING_HASH_H
 
 #include <vector>
+#include <string>
+#include <climits>
+#include <algorithm>
+#include <memory>
 #include <stdexcept>
+#include <type_traits>
 
 #include "Hash.hpp"
+#include "HashFunctions.hpp"
+#include "BulkBuild.hpp"
+#include "HashStats.hpp"
+#include "SlotLayout.hpp"
 
 using std::vector;
 using std::pair;
 
-// Can be used for tracking lazy deletion for each element in your table
-enum EntryState {
-    EMPTY = 0,
-    VALID = 1,
-    DELETED = 2
-};
-
-template<typename K, typename V>
-class ProbingHash : public Hash<K,V> { // derived from Hash
+//
+// Linear probing hash table - implements Hash (via StaticHash)
+//
+//  Keys are hashed with Hasher and given a home slot by SizePolicy (see
+//  HashFunctions.hpp); probing from there only steps and wraps. The table
+//  grows to SizePolicy::grow() of its size once the elements pass
+//  max_load_factor() (.75 by default) of the slots; reserve() makes room
+//  up front for a load of known size.
+//
+//  With incremental_rehash(true) growing no longer rebuilds the whole table
+//  inside one insert. The full table is kept aside as OldTable and every
+//  insert, erase and lookup moves at most REHASH_STEP of its slots into the
+//  new one, so each operation does a bounded amount of work; lookups and
+//  erases check both tables until OldTable is drained. Moved slots are left
+//  DELETED so probe chains through the old table stay intact. The one O(n)
+//  piece left in the triggering insert is allocating (and, unless Allocator
+//  hands out zeroed memory, clearing) the new slot array.
+//
+//  Erase leaves DELETED tombstones behind. Once they take up more than a
+//  quarter of the table, erase cleans them out in place (purge) without
+//  allocating. If the live count has dropped below an eighth of the table
+//  instead, the table is halved. In incremental mode both are done the way
+//  growing is, by moving the entries over step by step into a new table
+//  (of the same size, for the cleanup).
+//
+//  save() writes the slot array to a snapshot file and load_mmap() maps one
+//  back in place of the table's own slots (see Snapshot.hpp and
+//  SlotVector.hpp), so a restart can query a large table immediately
+//  instead of re-inserting every entry.
+//
+//  Layout decides how slots are stored (see SlotLayout.hpp): PairSlots, the
+//  default, keeps a std::pair<EntryState, V> per slot; PackedSlots keeps the
+//  states as 2-bit bitsets beside a dense value array, which about halves
+//  the table for int values. Only PairSlots tables can save() and
+//  load_mmap(), and only with trivially copyable keys and values.
+//
+//  Allocator supplies the slot arrays. With HugePageAllocator (see
+//  HugePageAllocator.hpp) large tables sit on huge pages, and a resize
+//  skips value-initializing the new array because mapped memory is already
+//  zero.
+//
+template<typename K, typename V, typename Hasher = MixHash<K>, typename SizePolicy = PrimeSize,
+         template<typename, typename> class Layout = PairSlots, typename Allocator = std::allocator<V>>
+class ProbingHash : public StaticHash<ProbingHash<K, V, Hasher, SizePolicy, Layout, Allocator>, K, V> {
 private:
+    template<typename> friend class HashAdapter;
+
+    enum { REHASH_STEP = 16, SHRINK_LIMIT = 64, BATCH_WINDOW = 16 };
+
     // Needs a table and a size.
-    // Table should be a vector of std::pairs for lazy deletion
-    std::vector<std::pair<EntryState, V>> Table;
+    // Every slot has an EntryState for lazy deletion
+    Layout<V, Allocator> Table;
     int numElements;
+    int numDeleted;
+    float MaxLoad;
+
+    Layout<V, Allocator> OldTable;
+    long unsigned int MigrateIndex;
+    bool Incremental;
+    Hasher HashFunction;
+    HASH_STATS_ONLY(StatsCounters Counters;)
 
 public:
     ProbingHash(int n = 11) {
         //this->tableSize = n;
-        this->Table.resize(n);
+        this->Table.reset(SizePolicy::size(n));
         this->numElements = 0;
+        this->numDeleted = 0;
+        this->MaxLoad = .75;
+        this->MigrateIndex = 0;
+        this->Incremental = false;
     }
 
     ~ProbingHash() {
-        // Needs to actually free all table contents
-        //this->tableSize = 0;
-        //this->Table.resize(0);
-        this->clear();
+        // Both tables free themselves
     }
 
     bool empty() {
-        for(long unsigned int I = 0; I < this->Table.size(); I++) {
-            if(this->Table[I].first == VALID)
-                return false;
-        }
-        return true;
+        return this->numElements == 0;
     }
 
     int size() {
@@ -53,73 +106,53 @@ public:
     }
 
     V& at(const K& key) {
-        int Index = this->hash(key);
-        for(long unsigned int I = 0; I < this->Table.size(); I++) {
-            if(this->Table[(Index + I) % this->Table.size()].first == VALID && this->Table[(Index + I) % this->Table.size()].second == key)
-                return this->Table[(Index + I) % this->Table.size()].second;
-        }
-        //throw std::out_of_range("Key not in hash");
-    }
-
-    V& operator[](const K& key) {
-        int Index = this->hash(key);
-        for(long unsigned int I = 0; I < this->Table.size(); I++) {
-            if(this->Table[(Index + I) % this->Table.size()].first == VALID && this->Table[(Index + I) % this->Table.size()].second == key)
-                return this->Table[(Index + I) % this->Table.size()].second;
-        }
-        //throw std::out_of_range("Key not in hash");
+        this->step();
+        int Index = this->find(this->Table, key);
+        if(Index >= 0)
+            return this->Table.value(Index);
+        Index = this->find(this->OldTable, key);
+        if(Index >= 0)
+            return this->OldTable.value(Index);
+        throw std::out_of_range("Key not in hash");
     }
 
     int count(const K& key) {
-        int Size = 0;
-        int Index = this->hash(key);
-        for(long unsigned int I = 0; I < this->Table.size(); I++) {
-            if(this->Table[(Index + I) % this->Table.size()].first == key)
-                Size += 1;
-        }
-        return Size;
+        this->step();
+        return this->count(this->Table, key) + this->count(this->OldTable, key);
     }
 
     void emplace(K key, V value) {
-        int Index = this->hash(key);
-        for(long unsigned int I = 0; I < this->Table.size(); I++) {
-            if(this->Table[(Index + I) % this->Table.size()].first == EMPTY || this->Table[(Index + I) % this->Table.size()].first == DELETED) {
-                this->Table[(Index + I) % this->Table.size()].first = VALID;
-                this->Table[(Index + I) % this->Table.size()].second = value;
-                this->numElements += 1;
-                if(this->load_factor() > .75)
-                    this->rehash();
-                return;
-            }
-        }
+        this->add(key, std::move(value));
     }
 
-    void insert(const std::pair<K, V>& pair) {
-        int Index = this->hash(pair.first);
-        for(long unsigned int I = 0; I < this->Table.size(); I++) {
-            if(this->Table[(Index + I) % this->Table.size()].first == EMPTY || this->Table[(Index + I) % this->Table.size()].first == DELETED) {
-                this->Table[(Index + I) % this->Table.size()].first = VALID;
-                this->Table[(Index + I) % this->Table.size()].second = pair.second;
-                this->numElements += 1;
-                if(this->load_factor() > .75)
-                    this->rehash();
-                return;
-            }
-        }
+    // Inserts V(args...) unless key is already in the table; returns
+    // whether it did. The value is constructed in its slot (see
+    // constructInPlace() in Hash.hpp). The key only picks the slot, so it
+    // is never copied or moved, and one const K& takes rvalue keys as well.
+    template<typename... Args>
+    bool try_emplace(const K& key, Args&&... args) {
+        if(this->count(key) != 0)
+            return false;
+        this->add(key, std::forward<Args>(args)...);
+        return true;
     }
 
     void erase(const K& key) {
-        int Index = this->hash(key);
-        for(long unsigned int I = 0; I < this->Table.size(); I++) {
-            if(this->Table[(Index + I) % this->Table.size()].first == VALID && this->Table[(Index + I) % this->Table.size()].second == key) {
-                this->Table[(Index + I) % this->Table.size()].first = DELETED;
-                this->numElements -= 1;
-            }    
-        }
+        this->step();
+        int Before = this->numElements;
+        this->erase(this->Table, key);
+        this->numDeleted += Before - this->numElements;
+        this->erase(this->OldTable, key);
+        if(this->numElements < Before)
+            this->tidy();
     }
 
     void clear() {
-        this->Table.clear();
+        this->Table.reset(this->Table.size());
+        Layout<V, Allocator>().swap(this->OldTable);
+        this->MigrateIndex = 0;
+        this->numElements = 0;
+        this->numDeleted = 0;
     }
 
     int bucket_count() {
@@ -127,19 +160,20 @@ public:
     }
 
     int bucket_size(int n) {
-        if(this->Table[n].first == 1)
+        if(this->Table.state(n) == VALID)
             return 1;
         return 0;
     }
 
+    // While a rehash is in progress a key still waiting in the old table
+    // reports its bucket there
     int bucket(const K& key) {
-        int Index = this->hash(key);
-        for(long unsigned int I = 0; I < this->Table.size(); I++) {
-            if(this->Table[(Index + I) % this->Table.size()].first == key) {
-                return (Index + I) % this->Table.size();
-            }    
-        }
-        throw std::out_of_range("Key not in hash");
+        int Index = this->find(this->Table, key);
+        if(Index < 0)
+            Index = this->find(this->OldTable, key);
+        if(Index < 0)
+            throw std::out_of_range("Key not in hash");
+        return Index;
     }
 
     float load_factor() {
@@ -147,66 +181,418 @@ public:
     }
 
     void rehash() {
-        int nSize = this->findNextPrime(2 * this->Table.size());
-        std::vector<std::pair<EntryState, V>> nTable;
-        nTable.resize(nSize);
-        for(long unsigned int I = 0; I < this->Table.size(); I++) {
-            if(this->Table[I].first == VALID) {
-                int Index = this->hash(this->Table[I].second);
-                long unsigned int L = 0;
-                for(L = 0; nTable[(Index + L) % nSize].first != EMPTY && nTable[(Index + L) % nSize].first != DELETED; L++) {}
-                nTable[(Index + L) % nSize].first = VALID;
-                nTable[(Index + L) % nSize].second = this->Table[I].second;
+        this->drain();
+        this->resize(SizePolicy::grow(this->Table.size()));
+    }
+
+    void rehash(int n) {
+        this->drain();
+        this->resize(SizePolicy::size(n));
+    }
+
+    float max_load_factor() {
+        return this->MaxLoad;
+    }
+
+    // The table must keep EMPTY slots to end its probes, so f stays below 1;
+    // it grows right away if it is already above f
+    void max_load_factor(float f) {
+        if(!(f > 0 && f < 1))
+            throw std::invalid_argument("Max load factor must be between 0 and 1");
+        this->MaxLoad = f;
+        this->reserve(this->numElements);
+    }
+
+    // Makes room for n elements, so inserting up to n never rehashes
+    void reserve(int n) {
+        if(n > (double)this->MaxLoad * this->Table.size())
+            this->rehash((int)(n / (double)this->MaxLoad) + 1);
+    }
+
+    // Looks up n keys at once: out[i] points at the value for keys[i], or is
+    // nullptr if it is missing. The home slot of key i + BATCH_WINDOW is
+    // hashed and prefetched while key i is resolved, so there are always
+    // BATCH_WINDOW misses in flight instead of one at a time.
+    void find_batch(const K* keys, size_t n, V** out) {
+        for(size_t I = 0; I < n; I++)
+            this->step();
+        long unsigned int Homes[BATCH_WINDOW];
+        for(size_t I = 0; I < n && I < BATCH_WINDOW; I++)
+            Homes[I] = this->prefetch(keys[I], 0);
+        for(size_t I = 0; I < n; I++) {
+            long unsigned int Home = Homes[I % BATCH_WINDOW];
+            if(I + BATCH_WINDOW < n)
+                Homes[I % BATCH_WINDOW] = this->prefetch(keys[I + BATCH_WINDOW], 0);
+            int Index = this->findFrom(this->Table, keys[I], Home);
+            if(Index >= 0) {
+                out[I] = &this->Table.value(Index);
+                continue;
             }
+            Index = this->find(this->OldTable, keys[I]);
+            out[I] = Index >= 0 ? &this->OldTable.value(Index) : nullptr;
+        }
+    }
 
-        }  
-        this->Table = nTable;
+    // Inserts keys[i] -> values[i] for i < n, prefetching the home slots of
+    // a window of keys before placing any of them. The table grows ahead of
+    // each window so the precomputed home slots stay valid.
+    void insert_batch(const K* keys, const V* values, size_t n) {
+        long unsigned int Homes[BATCH_WINDOW];
+        for(size_t Start = 0; Start < n; Start += BATCH_WINDOW) {
+            size_t Count = std::min(n - Start, (size_t)BATCH_WINDOW);
+            for(size_t I = 0; I < Count; I++)
+                this->step();
+            while(this->numElements + Count > this->MaxLoad * this->Table.size())
+                this->grow();
+            for(size_t I = 0; I < Count; I++)
+                Homes[I] = this->prefetch(keys[Start + I], 1);
+            for(size_t I = 0; I < Count; I++) {
+                if(this->placeAt(this->Table, Homes[I], values[Start + I]) == DELETED)
+                    this->numDeleted -= 1;
+                this->numElements += 1;
+            }
+        }
     }
-        
-    void rehash(int n) {
-        int nSize = this->findNextPrime(n);
-        std::vector<std::pair<EntryState, V>> nTable;
-        nTable.resize(nSize);
+
+    // Bulk load: sizes the table for n more elements once, radix-partitions
+    // data by home slot and fills the partitions from `threads` threads at
+    // once (see BulkBuild.hpp). Not safe to run concurrently with other
+    // operations.
+    void build_from(const std::pair<K, V>* data, size_t n, int threads) {
+        this->drain();
+        long unsigned int Needed = (long unsigned int)((this->numElements + n) / (double)this->MaxLoad) + 1;
+        if(this->Table.size() < Needed)
+            this->resize(SizePolicy::size(Needed));
+        if(threads < 1)
+            threads = 1;
+        long unsigned int Size = this->Table.size();
+        std::vector<std::pair<long unsigned int, size_t>> Order;
+        std::vector<size_t> Offsets;
+        partitionByHome(n, Size, threads, [&](size_t I) { return (long unsigned int)this->home(data[I].first, Size); }, Order, Offsets);
+
+        // Part P owns the slots whose home maps to it; an entry that would
+        // probe past the end of that range is left for the serial pass
+        std::vector<std::vector<size_t>> Spills(threads);
+        int Reused = 0;
+        #pragma omp parallel for schedule(dynamic) num_threads(threads) reduction(+:Reused)
+        for(int P = 0; P < threads; P++) {
+            long unsigned int End = ((uint64_t)(P + 1) * Size + threads - 1) / threads;
+            for(size_t I = Offsets[P]; I < Offsets[P + 1]; I++) {
+                long unsigned int Index = Order[I].first;
+                while(Index < End && this->Table.state_shared(Index) == VALID)
+                    Index++;
+                if(Index == End) {
+                    Spills[P].push_back(Order[I].second);
+                    continue;
+                }
+                if(this->Table.state_shared(Index) == DELETED)
+                    Reused += 1;
+                this->Table.set_shared(Index, VALID);
+                this->Table.value(Index) = data[Order[I].second].second;
+            }
+        }
+        for(int P = 0; P < threads; P++) {
+            for(size_t I = 0; I < Spills[P].size(); I++) {
+                if(this->place(this->Table, data[Spills[P][I]].first, data[Spills[P][I]].second) == DELETED)
+                    Reused += 1;
+            }
+        }
+        this->numElements += n;
+        this->numDeleted -= Reused;
+    }
+
+    // Smallest table that holds the current elements under the load factor
+    void shrink_to_fit() {
+        this->drain();
+        this->resize(SizePolicy::size((int)(this->numElements / (double)this->MaxLoad) + 1));
+    }
+
+    // Spread the cost of growing over the following operations instead of
+    // paying it all in the insert that crosses the load factor
+    void incremental_rehash(bool on) {
+        if(!on)
+            this->drain();
+        this->Incremental = on;
+    }
+
+    // Longest run of non-EMPTY slots and the tombstone share, plus the
+    // probe histograms and rehash counters when built with HASH_STATS
+    HashStats stats() {
+        HashStats Stats;
+        Stats.MaxCluster = longestRun(this->Table.size(), [&](long unsigned int I) { return this->Table.state(I) != EMPTY; });
+        Stats.Tombstones = this->numDeleted;
+        Stats.TombstoneRatio = (float)this->numDeleted / (float)this->Table.size();
+        HASH_STATS_ONLY(this->Counters.fill(Stats);)
+        return Stats;
+    }
+
+    // Writes the slot array to a snapshot file, finishing any incremental
+    // rehash first
+    void save(const std::string& path) {
+        static_assert(Layout<V, Allocator>::MAPPABLE, "Snapshots need the PairSlots layout");
+        static_assert(std::is_trivially_copyable<K>::value && std::is_trivially_copyable<V>::value,
+                      "Snapshots store raw bytes, so keys and values must be trivially copyable");
+        this->drain();
+        SnapshotHeader Header = snapshotHeader(sizeof(typename Layout<V, Allocator>::Slot), valueOffset(), this->Table.size(), this->numElements, this->numDeleted);
         for(long unsigned int I = 0; I < this->Table.size(); I++) {
-            if(this->Table[I].first == VALID) {
-                int Index = this->hash(this->Table[I].second);
-                long unsigned int L = 0;
-                for(L = 0; nTable[(Index + L) % nSize].first != EMPTY && nTable[(Index + L) % nSize].first != DELETED; L++) {}
-                nTable[(Index + L) % nSize].first = VALID;
-                nTable[(Index + L) % nSize].second = this->Table[I].second;
+            if(this->Table.state(I) == VALID) {
+                Header.CheckSlot = I;
+                Header.HashCheck = this->hash(this->Table.value(I));
+                Header.HomeCheck = this->home(this->Table.value(I), this->Table.size());
+                break;
             }
+        }
+        SnapshotWriter Out(path, Header);
+        Out.write(this->Table.data(), this->Table.size() * sizeof(typename Layout<V, Allocator>::Slot));
+        Out.finish();
+    }
 
-        }  
-        this->Table = nTable;
+    // Replaces the contents with a snapshot from save(). The file is mapped,
+    // not read: lookups run on its pages straight away, and the first write
+    // to a page copies only that page. Throws std::runtime_error if the file
+    // does not match this table type.
+    void load_mmap(const std::string& path) {
+        static_assert(Layout<V, Allocator>::MAPPABLE, "Snapshots need the PairSlots layout");
+        static_assert(std::is_trivially_copyable<K>::value && std::is_trivially_copyable<V>::value,
+                      "Snapshots store raw bytes, so keys and values must be trivially copyable");
+        MappedFile File;
+        File.open(path);
+        const SnapshotHeader& Header = File.header(snapshotHeader(sizeof(typename Layout<V, Allocator>::Slot), valueOffset(), 0, 0, 0));
+        long unsigned int Capacity = Header.Capacity;
+        std::pair<EntryState, V>* Slots = (std::pair<EntryState, V>*)(File.data() + Header.SlotOffset);
+        if(Capacity > INT_MAX || !SizePolicy::allows((int)Capacity))
+            throw std::runtime_error("Snapshot was written with a different size policy");
+        if(Header.Size > Capacity || Header.Deleted > Capacity - Header.Size)
+            throw std::runtime_error("Snapshot counts do not fit its capacity");
+        if(Header.CheckSlot < Capacity && (this->hash(Slots[Header.CheckSlot].second) != Header.HashCheck
+                                           || (uint64_t)this->home(Slots[Header.CheckSlot].second, Capacity) != Header.HomeCheck))
+            throw std::runtime_error("Snapshot was written with a different hash");
+        this->numElements = Header.Size;
+        this->numDeleted = Header.Deleted;
+        this->Table.adopt(File, Header.SlotOffset, Capacity);
+        Layout<V, Allocator>().swap(this->OldTable);
+        this->MigrateIndex = 0;
     }
 
 private:
-    int findNextPrime(int n)
-    {
-        while (!isPrime(n))
-        {
-            n++;
+    template<typename... Args>
+    void add(const K& key, Args&&... args) {
+        this->step();
+        if(this->place(this->Table, key, std::forward<Args>(args)...) == DELETED)
+            this->numDeleted -= 1;
+        this->numElements += 1;
+        if(this->load_factor() > this->MaxLoad)
+            this->grow();
+    }
+
+    int home(const K& key, long unsigned int Size) {
+        return SizePolicy::index(this->hash(key), Size);
+    }
+
+    static uint32_t valueOffset() {
+        std::pair<EntryState, V> Slot;
+        return (uint32_t)((char*)&Slot.second - (char*)&Slot);
+    }
+
+    // Home slot of key in Table, with its cache line already requested
+    long unsigned int prefetch(const K& key, int Write) {
+        long unsigned int Home = this->home(key, this->Table.size());
+        this->Table.prefetch(Home, Write);
+        return Home;
+    }
+
+    // Index of the valid slot holding key, or -1 once an EMPTY slot ends the probe
+    int find(Layout<V, Allocator>& T, const K& key) {
+        if(T.empty())
+            return -1;
+        return this->findFrom(T, key, this->home(key, T.size()));
+    }
+
+    int findFrom(Layout<V, Allocator>& T, const K& key, long unsigned int Index) {
+        for(long unsigned int I = 0; I < T.size(); I++) {
+            if(T.state(Index) == EMPTY) {
+                HASH_STATS_ONLY(this->Counters.miss(I + 1);)
+                return -1;
+            }
+            if(T.state(Index) == VALID && T.value(Index) == key) {
+                HASH_STATS_ONLY(this->Counters.hit(I + 1);)
+                return Index;
+            }
+            if(++Index == T.size())
+                Index = 0;
         }
-        return n;
+        HASH_STATS_ONLY(this->Counters.miss(T.size());)
+        return -1;
     }
 
-    int isPrime(int n)
-    {
-        for (int i = 2; i <= sqrt(n); i++)
-        {
-            if (n % i == 0)
-            {
-                return false;
+    int count(Layout<V, Allocator>& T, const K& key) {
+        int Size = 0;
+        long unsigned int Index = T.empty() ? 0 : this->home(key, T.size());
+        long unsigned int I = 0;
+        HASH_STATS_ONLY(long unsigned int First = 0;)
+        for(; I < T.size(); I++) {
+            if(T.state(Index) == EMPTY)
+                break;
+            if(T.state(Index) == VALID && T.value(Index) == key) {
+                HASH_STATS_ONLY(if(Size == 0) First = I + 1;)
+                Size += 1;
             }
+            if(++Index == T.size())
+                Index = 0;
         }
+        // A hit is charged up to its first match, what find() would pay
+        HASH_STATS_ONLY(if(Size > 0) this->Counters.hit(First); else if(!T.empty()) this->Counters.miss(std::min(I + 1, T.size()));)
+        return Size;
+    }
 
-        return true;
+    void erase(Layout<V, Allocator>& T, const K& key) {
+        long unsigned int Index = T.empty() ? 0 : this->home(key, T.size());
+        for(long unsigned int I = 0; I < T.size(); I++) {
+            if(T.state(Index) == EMPTY)
+                break;
+            if(T.state(Index) == VALID && T.value(Index) == key) {
+                T.set(Index, DELETED);
+                this->numElements -= 1;
+            }
+            if(++Index == T.size())
+                Index = 0;
+        }
+    }
+
+    // Returns what the slot held before (EMPTY or DELETED). key is hashed
+    // before the value is built, so args may name the slot key refers to.
+    template<typename... Args>
+    EntryState place(Layout<V, Allocator>& Slots, const K& key, Args&&... args) {
+        return this->placeAt(Slots, this->home(key, Slots.size()), std::forward<Args>(args)...);
     }
 
-    int hash(const K& key) {
-        return (int)key;       
+    // The slot only turns VALID once its value is built, so a throwing
+    // constructor leaves the table as it was
+    template<typename... Args>
+    EntryState placeAt(Layout<V, Allocator>& Slots, long unsigned int Index, Args&&... args) {
+        Index = Slots.nextFree(Index);
+        EntryState Previous = Slots.state(Index);
+        constructInPlace(Slots.value(Index), std::forward<Args>(args)...);
+        Slots.set(Index, VALID);
+        return Previous;
     }
-    
+
+    void grow() {
+        this->rebuild(SizePolicy::grow(this->Table.size()));
+    }
+
+    // Moves everything into a table of nSize slots, all at once or, in
+    // incremental mode, REHASH_STEP slots per operation
+    void rebuild(int nSize) {
+        if(!this->Incremental) {
+            this->resize(nSize);
+            return;
+        }
+        // REHASH_STEP is large enough that the previous move has always
+        // finished by the time the new table fills up; drain() is a safety net
+        this->drain();
+        HASH_STATS_ONLY(this->Counters.rehash(); StatsCounters::Timer RehashTimer(this->Counters);)
+        this->OldTable.swap(this->Table);
+        this->Table.reset(nSize);
+        this->numDeleted = 0;
+        this->MigrateIndex = 0;
+    }
+
+    // Moves up to REHASH_STEP slots of the old table into the current one
+    void step() {
+        if(this->OldTable.empty())
+            return;
+        HASH_STATS_ONLY(StatsCounters::Timer RehashTimer(this->Counters);)
+        long unsigned int End = std::min(this->OldTable.size(), this->MigrateIndex + REHASH_STEP);
+        for(; this->MigrateIndex < End; this->MigrateIndex++) {
+            if(this->OldTable.state(this->MigrateIndex) == VALID) {
+                if(this->place(this->Table, this->OldTable.value(this->MigrateIndex), std::move(this->OldTable.value(this->MigrateIndex))) == DELETED)
+                    this->numDeleted -= 1;
+                this->OldTable.set(this->MigrateIndex, DELETED);
+            }
+        }
+        if(this->MigrateIndex == this->OldTable.size()) {
+            Layout<V, Allocator>().swap(this->OldTable);
+            this->MigrateIndex = 0;
+        }
+    }
+
+    void drain() {
+        while(!this->OldTable.empty())
+            this->step();
+    }
+
+    // Runs after an erase that removed something, never mid-migration. In
+    // incremental mode a purge would cost O(n) in one erase, so tombstones
+    // are left behind by a same-size rebuild instead.
+    void tidy() {
+        if(!this->OldTable.empty())
+            return;
+        // The halved table must stay under the load factor too
+        if(this->Table.size() > SHRINK_LIMIT && this->numElements < std::min(.125f, this->MaxLoad / 4) * this->Table.size())
+            this->rebuild(SizePolicy::size(this->Table.size() / 2));
+        else if((long unsigned int)this->numDeleted * 4 > this->Table.size()) {
+            if(this->Incremental)
+                this->rebuild(this->Table.size());
+            else
+                this->purge();
+        }
+    }
+
+    // Drops every tombstone without a second table. Live slots are first
+    // marked DELETED ("still to place") and tombstones become EMPTY; then
+    // each pending entry moves to the first non-VALID slot on its probe
+    // sequence, trading places with a pending entry if that is what it
+    // finds. VALID slots never move again, so every finished probe chain
+    // stays unbroken.
+    void purge() {
+        HASH_STATS_ONLY(this->Counters.rehash(); StatsCounters::Timer RehashTimer(this->Counters);)
+        long unsigned int Size = this->Table.size();
+        for(long unsigned int I = 0; I < Size; I++)
+            this->Table.set(I, this->Table.state(I) == VALID ? DELETED : EMPTY);
+        for(long unsigned int I = 0; I < Size; I++) {
+            if(this->Table.state(I) != DELETED)
+                continue;
+            long unsigned int Index = this->home(this->Table.value(I), Size);
+            while(this->Table.state(Index) == VALID) {
+                if(++Index == Size)
+                    Index = 0;
+            }
+            if(Index == I) {
+                this->Table.set(I, VALID);
+            }
+            else if(this->Table.state(Index) == EMPTY) {
+                this->Table.set(Index, VALID);
+                this->Table.value(Index) = std::move(this->Table.value(I));
+                this->Table.set(I, EMPTY);
+            }
+            else {
+                // Index holds a pending entry too: swap, then place the one now at I
+                std::swap(this->Table.value(Index), this->Table.value(I));
+                this->Table.set(Index, VALID);
+                I--;
+            }
+        }
+        this->numDeleted = 0;
+    }
+
+    void resize(int nSize) {
+        HASH_STATS_ONLY(this->Counters.rehash(); StatsCounters::Timer RehashTimer(this->Counters);)
+        Layout<V, Allocator> nTable;
+        nTable.reset(nSize);
+        for(long unsigned int I = 0; I < this->Table.size(); I++) {
+            if(this->Table.state(I) == VALID)
+                this->place(nTable, this->Table.value(I), std::move(this->Table.value(I)));
+        }
+        this->Table.swap(nTable);
+        this->numDeleted = 0;
+    }
+
+
+    size_t hash(const K& key) {
+        return this->HashFunction(key);
+    }
+
 };
 
 #endif //__PROBING_HASH_H
@@ -0,0 +1,283 @@
+#pragma once
+
+#ifndef __ROBIN_HOOD_HASH_H
+#define __ROBIN_HOOD_HASH_H
+
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <stdexcept>
+
+#include "Hash.hpp"
+#include "HashFunctions.hpp"
+#include "HashStats.hpp"
+
+//
+// Robin Hood linear probing hash table - implements Hash (via StaticHash)
+//
+//  Every slot stores how far its entry sits from its home slot (-1 when the
+//  slot is empty). An insert that meets an entry closer to home than itself
+//  takes that slot and carries the displaced entry on, so along any probe
+//  sequence the stored distances never fall by more than one per step. That
+//  lets a lookup stop as soon as its own distance exceeds the resident's,
+//  and a miss costs about as much as a hit instead of a walk to the next
+//  EMPTY slot.
+//
+//  Erase shifts the following entries of the cluster back by one slot
+//  (backward-shift deletion), so no tombstones are ever left behind.
+//
+//  The table grows to SizePolicy::grow() of its size once the elements pass
+//  max_load_factor() (.75 by default) of the slots. Robin Hood keeps probes
+//  short enough that higher loads are worth trying here.
+//
+template<typename K, typename V, typename Hasher = MixHash<K>, typename SizePolicy = PrimeSize>
+class RobinHoodHash : public StaticHash<RobinHoodHash<K, V, Hasher, SizePolicy>, K, V> {
+private:
+    template<typename> friend class HashAdapter;
+
+    enum { NO_ENTRY = -1 };
+
+    // Probe distance and value
+    std::vector<std::pair<int, V>> Table;
+    int numElements;
+    float MaxLoad;
+    Hasher HashFunction;
+    HASH_STATS_ONLY(StatsCounters Counters;)
+
+public:
+    RobinHoodHash(int n = 11) {
+        this->Table.assign(SizePolicy::size(n), std::pair<int, V>(NO_ENTRY, V()));
+        this->numElements = 0;
+        this->MaxLoad = .75;
+    }
+
+    ~RobinHoodHash() {
+    }
+
+    bool empty() {
+        return this->numElements == 0;
+    }
+
+    int size() {
+        return this->numElements;
+    }
+
+    V& at(const K& key) {
+        int Index = this->find(key);
+        if(Index < 0)
+            throw std::out_of_range("Key not in hash");
+        return this->Table[Index].second;
+    }
+
+    int count(const K& key) {
+        int Size = 0;
+        long unsigned int Index = this->home(key, this->Table.size());
+        int Distance = 0;
+        HASH_STATS_ONLY(int First = 0;)
+        for(; this->Table[Index].first >= Distance; Distance++) {
+            if(this->Table[Index].second == key) {
+                HASH_STATS_ONLY(if(Size == 0) First = Distance + 1;)
+                Size += 1;
+            }
+            if(++Index == this->Table.size())
+                Index = 0;
+        }
+        // A hit is charged up to its first match, what find() would pay
+        HASH_STATS_ONLY(if(Size > 0) this->Counters.hit(First); else this->Counters.miss(Distance + 1);)
+        return Size;
+    }
+
+    void emplace(K key, V value) {
+        this->add(key, std::move(value));
+    }
+
+    // Inserts V(args...) unless key is already in the table; returns
+    // whether it did. The value is constructed in the slot it takes (see
+    // constructInPlace() in Hash.hpp), and the key is never stored.
+    template<typename... Args>
+    bool try_emplace(const K& key, Args&&... args) {
+        if(this->find(key) >= 0)
+            return false;
+        this->add(key, std::forward<Args>(args)...);
+        return true;
+    }
+
+    void erase(const K& key) {
+        for(int Index = this->find(key); Index >= 0; Index = this->find(key)) {
+            this->shiftBack(Index);
+            this->numElements -= 1;
+        }
+    }
+
+    void clear() {
+        this->Table.assign(this->Table.size(), std::pair<int, V>(NO_ENTRY, V()));
+        this->numElements = 0;
+    }
+
+    int bucket_count() {
+        return this->Table.size();
+    }
+
+    int bucket_size(int n) {
+        if(this->Table[n].first != NO_ENTRY)
+            return 1;
+        return 0;
+    }
+
+    int bucket(const K& key) {
+        int Index = this->find(key);
+        if(Index < 0)
+            throw std::out_of_range("Key not in hash");
+        return Index;
+    }
+
+    float load_factor() {
+        return (float)this->numElements / (float)this->Table.size();
+    }
+
+    void rehash() {
+        this->resize(SizePolicy::grow(this->Table.size()));
+    }
+
+    void rehash(int n) {
+        this->resize(SizePolicy::size(n));
+    }
+
+    float max_load_factor() {
+        return this->MaxLoad;
+    }
+
+    // A probe needs an empty slot to end on, so f stays below 1; the table
+    // grows right away if it is already above f
+    void max_load_factor(float f) {
+        if(!(f > 0 && f < 1))
+            throw std::invalid_argument("Max load factor must be between 0 and 1");
+        this->MaxLoad = f;
+        this->reserve(this->numElements);
+    }
+
+    // Makes room for n elements, so inserting up to n never rehashes
+    void reserve(int n) {
+        if(n > (double)this->MaxLoad * this->Table.size())
+            this->rehash((int)(n / (double)this->MaxLoad) + 1);
+    }
+
+    // Longest distance any entry sits from its home slot
+    int max_probe_distance() {
+        int Longest = 0;
+        for(long unsigned int I = 0; I < this->Table.size(); I++)
+            Longest = std::max(Longest, this->Table[I].first);
+        return Longest;
+    }
+
+    // Longest run of occupied slots, plus the probe histograms and rehash
+    // counters when built with HASH_STATS. Backward-shift erase leaves no
+    // tombstones.
+    HashStats stats() {
+        HashStats Stats;
+        Stats.MaxCluster = longestRun(this->Table.size(), [&](long unsigned int I) { return this->Table[I].first != NO_ENTRY; });
+        HASH_STATS_ONLY(this->Counters.fill(Stats);)
+        return Stats;
+    }
+
+private:
+    template<typename... Args>
+    void add(const K& key, Args&&... args) {
+        this->place(this->Table, key, std::forward<Args>(args)...);
+        this->numElements += 1;
+        if(this->load_factor() > this->MaxLoad)
+            this->resize(SizePolicy::grow(this->Table.size()));
+    }
+
+    int home(const K& key, long unsigned int Size) {
+        return SizePolicy::index(this->hash(key), Size);
+    }
+
+    // Index of the slot holding key, or -1 once the probe is further from
+    // home than the resident entry
+    int find(const K& key) {
+        long unsigned int Index = this->home(key, this->Table.size());
+        int Distance = 0;
+        for(; this->Table[Index].first >= Distance; Distance++) {
+            if(this->Table[Index].second == key) {
+                HASH_STATS_ONLY(this->Counters.hit(Distance + 1);)
+                return Index;
+            }
+            if(++Index == this->Table.size())
+                Index = 0;
+        }
+        HASH_STATS_ONLY(this->Counters.miss(Distance + 1);)
+        return -1;
+    }
+
+    // Builds V(args...) in the slot the new entry takes: the first one that
+    // is empty or whose entry sits closer to home. An entry displaced from
+    // there is moved on down the cluster. key is hashed before the value is
+    // built, so args may name the slot key refers to.
+    template<typename... Args>
+    void place(std::vector<std::pair<int, V>>& T, const K& key, Args&&... args) {
+        long unsigned int Index = this->home(key, T.size());
+        int Distance = 0;
+        while(T[Index].first != NO_ENTRY && T[Index].first >= Distance) {
+            Distance += 1;
+            if(++Index == T.size())
+                Index = 0;
+        }
+        if(T[Index].first == NO_ENTRY) {
+            constructInPlace(T[Index].second, std::forward<Args>(args)...);
+            T[Index].first = Distance;
+            return;
+        }
+        std::pair<int, V> Entry(T[Index].first, std::move(T[Index].second));
+        try {
+            constructInPlace(T[Index].second, std::forward<Args>(args)...);
+        }
+        catch(...) {
+            T[Index].second = std::move(Entry.second);
+            throw;
+        }
+        T[Index].first = Distance;
+        do {
+            Entry.first += 1;
+            if(++Index == T.size())
+                Index = 0;
+            if(T[Index].first != NO_ENTRY && T[Index].first < Entry.first)
+                std::swap(T[Index], Entry);
+        } while(T[Index].first != NO_ENTRY);
+        T[Index] = std::move(Entry);
+    }
+
+    // Pulls the rest of the cluster after Index back one slot
+    void shiftBack(long unsigned int Index) {
+        long unsigned int Next = Index + 1 == this->Table.size() ? 0 : Index + 1;
+        while(this->Table[Next].first > 0) {
+            this->Table[Index].first = this->Table[Next].first - 1;
+            this->Table[Index].second = std::move(this->Table[Next].second);
+            Index = Next;
+            if(++Next == this->Table.size())
+                Next = 0;
+        }
+        this->Table[Index].first = NO_ENTRY;
+    }
+
+    void resize(int nSize) {
+        int Minimum = SizePolicy::size((int)(this->numElements / (double)this->MaxLoad) + 1);
+        if(nSize < Minimum)
+            nSize = Minimum;
+        HASH_STATS_ONLY(this->Counters.rehash(); StatsCounters::Timer RehashTimer(this->Counters);)
+        std::vector<std::pair<int, V>> nTable(nSize, std::pair<int, V>(NO_ENTRY, V()));
+        for(long unsigned int I = 0; I < this->Table.size(); I++) {
+            if(this->Table[I].first != NO_ENTRY)
+                this->place(nTable, this->Table[I].second, std::move(this->Table[I].second));
+        }
+        this->Table.swap(nTable);
+    }
+
+
+    size_t hash(const K& key) {
+        return this->HashFunction(key);
+    }
+
+};
+
+#endif //__ROBIN_HOOD_HASH_H
@@ -0,0 +1,222 @@
+#pragma once
+
+#ifndef __SLOT_LAYOUT_H
+#define __SLOT_LAYOUT_H
+
+#include <memory>
+#include <utility>
+#include <cstdint>
+#include <cstddef>
+
+#include "SlotVector.hpp"
+
+// Can be used for tracking lazy deletion for each element in your table
+enum EntryState {
+    EMPTY = 0,
+    VALID = 1,
+    DELETED = 2
+};
+
+//
+// Slot layouts for ProbingHash
+//
+//  ProbingHash reads and writes its slots only through the members below,
+//  so how a slot's state and value are stored is a template parameter.
+//  reset(n) makes n EMPTY slots, and nextFree(i) is the first slot from i
+//  on (wrapping) that is not VALID; the table is never full, so it always
+//  finds one. Both layouts keep their arrays in SlotVectors drawing on
+//  Allocator.
+//
+
+//
+// A std::pair<EntryState, V> per slot (the default). Simple, and the only
+// layout a snapshot can map in place (see Snapshot.hpp), but with int values
+// half of every slot is a 4-byte enum.
+//
+template<typename V, typename Allocator = std::allocator<V>>
+class PairSlots {
+private:
+    SlotVector<std::pair<EntryState, V>, Allocator> Slots;
+
+public:
+    enum { MAPPABLE = 1 };
+
+    typedef std::pair<EntryState, V> Slot;
+
+    size_t size() const {
+        return this->Slots.size();
+    }
+
+    bool empty() const {
+        return this->Slots.empty();
+    }
+
+    EntryState state(size_t I) const {
+        return this->Slots[I].first;
+    }
+
+    void set(size_t I, EntryState S) {
+        this->Slots[I].first = S;
+    }
+
+    // state() and set() for threads filling disjoint slot ranges at once
+    EntryState state_shared(size_t I) const {
+        return this->Slots[I].first;
+    }
+
+    void set_shared(size_t I, EntryState S) {
+        this->Slots[I].first = S;
+    }
+
+    V& value(size_t I) {
+        return this->Slots[I].second;
+    }
+
+    size_t nextFree(size_t I) const {
+        while(this->Slots[I].first == VALID) {
+            if(++I == this->Slots.size())
+                I = 0;
+        }
+        return I;
+    }
+
+    void prefetch(size_t I, int Write) const {
+        if(Write)
+            __builtin_prefetch(&this->Slots[I], 1);
+        else
+            __builtin_prefetch(&this->Slots[I], 0);
+    }
+
+    void reset(size_t n) {
+        this->Slots.reset(n);
+    }
+
+    void swap(PairSlots& Other) {
+        this->Slots.swap(Other.Slots);
+    }
+
+    static double bytes_per_slot() {
+        return sizeof(Slot);
+    }
+
+    // For save() and load_mmap()
+    Slot* data() {
+        return this->Slots.data();
+    }
+
+    void adopt(MappedFile& File, size_t Offset, size_t n) {
+        this->Slots.adopt(File, Offset, n);
+    }
+};
+
+//
+// Slot states as two bitsets, apart from a dense value array. Each 64-slot
+// word pairs a VALID bit and a DELETED bit per slot (neither set is EMPTY),
+// so a slot's state costs 2 bits instead of a whole enum, a cache line of
+// values holds twice as many int slots, and probing for a free slot tests
+// 64 slots per word. Bits past the last slot are kept VALID so nextFree()
+// never stops on them. reset() only clears the state words; values are
+// written before they are read, so trivial ones are left uninitialized.
+//
+template<typename V, typename Allocator = std::allocator<V>>
+class PackedSlots {
+private:
+    struct StateWord {
+        uint64_t Valid;
+        uint64_t Deleted;
+    };
+
+    SlotVector<StateWord, Allocator> States;
+    SlotVector<V, Allocator> Values;
+
+public:
+    enum { MAPPABLE = 0 };
+
+    size_t size() const {
+        return this->Values.size();
+    }
+
+    bool empty() const {
+        return this->Values.empty();
+    }
+
+    // VALID is 1 and DELETED is 2, and a slot never has both bits
+    EntryState state(size_t I) const {
+        const StateWord& W = this->States[I >> 6];
+        return (EntryState)(((W.Valid >> (I & 63)) & 1) | (((W.Deleted >> (I & 63)) & 1) << 1));
+    }
+
+    void set(size_t I, EntryState S) {
+        StateWord& W = this->States[I >> 6];
+        uint64_t Bit = (uint64_t)1 << (I & 63);
+        W.Valid = (W.Valid & ~Bit) | (S == VALID ? Bit : 0);
+        W.Deleted = (W.Deleted & ~Bit) | (S == DELETED ? Bit : 0);
+    }
+
+    // Neighbouring slot ranges can share a word, so these are atomic. Only
+    // the thread that owns slot I changes its bits, so relaxed is enough.
+    EntryState state_shared(size_t I) const {
+        const StateWord& W = this->States[I >> 6];
+        uint64_t Valid = __atomic_load_n(&W.Valid, __ATOMIC_RELAXED);
+        uint64_t Deleted = __atomic_load_n(&W.Deleted, __ATOMIC_RELAXED);
+        return (EntryState)(((Valid >> (I & 63)) & 1) | (((Deleted >> (I & 63)) & 1) << 1));
+    }
+
+    void set_shared(size_t I, EntryState S) {
+        StateWord& W = this->States[I >> 6];
+        uint64_t Bit = (uint64_t)1 << (I & 63);
+        if(S == VALID)
+            __atomic_fetch_or(&W.Valid, Bit, __ATOMIC_RELAXED);
+        else
+            __atomic_fetch_and(&W.Valid, ~Bit, __ATOMIC_RELAXED);
+        if(S == DELETED)
+            __atomic_fetch_or(&W.Deleted, Bit, __ATOMIC_RELAXED);
+        else
+            __atomic_fetch_and(&W.Deleted, ~Bit, __ATOMIC_RELAXED);
+    }
+
+    V& value(size_t I) {
+        return this->Values[I];
+    }
+
+    // The lowest clear VALID bit at or after I, a word at a time
+    size_t nextFree(size_t I) const {
+        size_t Word = I >> 6;
+        uint64_t Free = ~this->States[Word].Valid & (~(uint64_t)0 << (I & 63));
+        while(Free == 0) {
+            if(++Word == this->States.size())
+                Word = 0;
+            Free = ~this->States[Word].Valid;
+        }
+        return (Word << 6) + __builtin_ctzll(Free);
+    }
+
+    void prefetch(size_t I, int Write) const {
+        if(Write) {
+            __builtin_prefetch(&this->States[I >> 6], 1);
+            __builtin_prefetch(&this->Values[I], 1);
+        }
+        else {
+            __builtin_prefetch(&this->States[I >> 6], 0);
+            __builtin_prefetch(&this->Values[I], 0);
+        }
+    }
+
+    void reset(size_t n) {
+        this->States.reset((n + 63) / 64);
+        this->Values.reset(n, false);
+        if(n % 64 != 0)
+            this->States[this->States.size() - 1].Valid = ~(uint64_t)0 << (n % 64);
+    }
+
+    void swap(PackedSlots& Other) {
+        this->States.swap(Other.States);
+        this->Values.swap(Other.Values);
+    }
+
+    static double bytes_per_slot() {
+        return sizeof(V) + 2.0 / 8;
+    }
+};
+
+#endif //__SLOT_LAYOUT_H
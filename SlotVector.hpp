@@ -0,0 +1,166 @@
+#pragma once
+
+#ifndef __SLOT_VECTOR_H
+#define __SLOT_VECTOR_H
+
+#include <new>
+#include <memory>
+#include <utility>
+#include <algorithm>
+#include <type_traits>
+#include <cstddef>
+
+#include "Snapshot.hpp"
+#include "HugePageAllocator.hpp"
+
+//
+// Slot storage for the tables
+//
+//  The subset of std::vector the tables use, over slots that either live in
+//  memory from Allocator or in a mapped snapshot (see Snapshot.hpp).
+//  Indexing goes through one pointer either way, so the table's loops do not
+//  care which. reset() always starts over in fresh memory and lets any
+//  mapping go.
+//
+//  Fresh slots are value-initialized one by one only when they have to be:
+//  an allocator that returns zeroed memory (see HugePageAllocator.hpp) has
+//  already done it for types whose zero bytes are a value-initialized slot.
+//
+template<typename T, typename Allocator = std::allocator<T>>
+class SlotVector {
+private:
+    typedef typename std::allocator_traits<Allocator>::template rebind_alloc<T> SlotAllocator;
+    typedef std::allocator_traits<SlotAllocator> Traits;
+
+    SlotAllocator Alloc;
+    T* Owned;
+    MappedFile Mapping;
+    T* Data;
+    size_t Count;
+
+    // Takes n slots from the allocator, constructing them if Construct is set
+    void allocate(size_t n, bool Construct) {
+        if(n == 0)
+            return;
+        T* Slots = Traits::allocate(this->Alloc, n);
+        size_t I = 0;
+        try {
+            if(Construct) {
+                for(; I < n; I++)
+                    ::new((void*)(Slots + I)) T();
+            }
+        }
+        catch(...) {
+            while(I > 0)
+                Slots[--I].~T();
+            Traits::deallocate(this->Alloc, Slots, n);
+            throw;
+        }
+        this->Owned = this->Data = Slots;
+        this->Count = n;
+    }
+
+    void release() {
+        if(this->Owned != nullptr) {
+            if(!std::is_trivially_destructible<T>::value) {
+                for(size_t I = 0; I < this->Count; I++)
+                    this->Owned[I].~T();
+            }
+            Traits::deallocate(this->Alloc, this->Owned, this->Count);
+        }
+        this->Mapping.reset();
+        this->Owned = this->Data = nullptr;
+        this->Count = 0;
+    }
+
+public:
+    SlotVector() : Owned(nullptr), Data(nullptr), Count(0) {}
+
+    SlotVector(const SlotVector& Other) : Owned(nullptr), Data(nullptr), Count(0) {
+        if(Other.Count == 0)
+            return;
+        T* Slots = Traits::allocate(this->Alloc, Other.Count);
+        try {
+            std::uninitialized_copy(Other.Data, Other.Data + Other.Count, Slots);
+        }
+        catch(...) {
+            Traits::deallocate(this->Alloc, Slots, Other.Count);
+            throw;
+        }
+        this->Owned = this->Data = Slots;
+        this->Count = Other.Count;
+    }
+
+    SlotVector(SlotVector&& Other) noexcept : Owned(nullptr), Data(nullptr), Count(0) {
+        this->swap(Other);
+    }
+
+    SlotVector& operator=(const SlotVector& Other) {
+        if(this != &Other) {
+            SlotVector Copy(Other);
+            this->swap(Copy);
+        }
+        return *this;
+    }
+
+    SlotVector& operator=(SlotVector&& Other) noexcept {
+        this->swap(Other);
+        return *this;
+    }
+
+    ~SlotVector() {
+        this->release();
+    }
+
+    size_t size() const {
+        return this->Count;
+    }
+
+    bool empty() const {
+        return this->Count == 0;
+    }
+
+    T& operator[](size_t I) {
+        return this->Data[I];
+    }
+
+    const T& operator[](size_t I) const {
+        return this->Data[I];
+    }
+
+    T* data() {
+        return this->Data;
+    }
+
+    bool mapped() const {
+        return this->Mapping.size() != 0;
+    }
+
+    // Replaces the slots with n fresh value-initialized ones. With Initialize
+    // false, slots of a trivial type are left as the allocator returned them,
+    // for callers that never read a slot before writing it.
+    void reset(size_t n, bool Initialize = true) {
+        bool Zeroed = ZeroedAllocation<SlotAllocator>::value && ZeroInitializable<T>::value;
+        bool Construct = !Zeroed && (Initialize || !std::is_trivial<T>::value);
+        this->release();
+        this->allocate(n, Construct);
+    }
+
+    void swap(SlotVector& Other) {
+        std::swap(this->Alloc, Other.Alloc);
+        std::swap(this->Owned, Other.Owned);
+        std::swap(this->Mapping, Other.Mapping);
+        std::swap(this->Data, Other.Data);
+        std::swap(this->Count, Other.Count);
+    }
+
+    // Takes over n slots starting Offset bytes into File
+    void adopt(MappedFile& File, size_t Offset, size_t n) {
+        this->release();
+        this->Mapping = std::move(File);
+        this->Data = (T*)(this->Mapping.data() + Offset);
+        this->Count = n;
+    }
+};
+
+#endif //__SLOT_VECTOR_H
@@ -0,0 +1,183 @@
+#pragma once
+
+#ifndef __SNAPSHOT_H
+#define __SNAPSHOT_H
+
+#include <string>
+#include <fstream>
+#include <cstring>
+#include <cstdint>
+#include <cstddef>
+#include <stdexcept>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+//
+// On-disk snapshots of the open addressing tables' slot arrays
+//
+//  A snapshot file is a SnapshotHeader followed, at SlotOffset, by the slot
+//  array exactly as the table keeps it in memory: Capacity slots of SlotSize
+//  bytes, each a 32-bit EntryState word and the value at ValueOffset. There
+//  are no pointers, so the file can be mapped at any address and queried
+//  where it lies; loading is an mmap plus a header check, with no parsing
+//  and no copy.
+//
+//  Tables map the file private and writable. Lookups read the file's pages
+//  straight from the page cache; the first write to a page gives the
+//  process its own copy of that page (the file never changes), and growing
+//  moves the table into ordinary memory as any resize does.
+//
+//  The header records what the slots depend on: the slot layout, the byte
+//  order, and for one stored entry its slot, hash and home slot as the
+//  writer's Hasher and SizePolicy gave them. The tables have no hash seed of
+//  their own, so that entry stands in for one: a snapshot only loads into a
+//  table that hashes and places it the same way.
+//
+enum { SNAPSHOT_VERSION = 1, SNAPSHOT_ALIGN = 64 };
+
+struct SnapshotHeader {
+    char Magic[8];          // "HASHSNAP"
+    uint32_t Version;
+    uint32_t ByteOrder;     // 0x01020304 as the writer stored it
+    uint32_t SlotSize;
+    uint32_t ValueOffset;
+    uint64_t SlotOffset;    // from the start of the file
+    uint64_t Capacity;      // slots
+    uint64_t Size;          // live entries
+    uint64_t Deleted;       // tombstones
+    uint64_t CheckSlot;     // a live slot, or Capacity if there is none
+    uint64_t HashCheck;     // hash of the entry in CheckSlot
+    uint64_t HomeCheck;     // and its home slot
+};
+
+// Header for Capacity slots of the given layout; the caller fills in the check entry
+inline SnapshotHeader snapshotHeader(uint32_t SlotSize, uint32_t ValueOffset, uint64_t Capacity, uint64_t Size, uint64_t Deleted) {
+    SnapshotHeader Header;
+    memset(&Header, 0, sizeof(Header));
+    memcpy(Header.Magic, "HASHSNAP", 8);
+    Header.Version = SNAPSHOT_VERSION;
+    Header.ByteOrder = 0x01020304;
+    Header.SlotSize = SlotSize;
+    Header.ValueOffset = ValueOffset;
+    Header.SlotOffset = (sizeof(SnapshotHeader) + SNAPSHOT_ALIGN - 1) / SNAPSHOT_ALIGN * SNAPSHOT_ALIGN;
+    Header.Capacity = Capacity;
+    Header.Size = Size;
+    Header.Deleted = Deleted;
+    Header.CheckSlot = Capacity;
+    return Header;
+}
+
+// Writes the header, then the slot array in as many pieces as the caller likes
+class SnapshotWriter {
+private:
+    std::ofstream Out;
+    std::string Path;
+
+public:
+    SnapshotWriter(const std::string& path, const SnapshotHeader& Header) : Out(path.c_str(), std::ios::binary | std::ios::trunc), Path(path) {
+        if(!this->Out)
+            throw std::runtime_error("Cannot write snapshot " + path);
+        this->Out.write((const char*)&Header, sizeof(Header));
+        for(uint64_t I = sizeof(Header); I < Header.SlotOffset; I++)
+            this->Out.put(0);
+    }
+
+    void write(const void* Slots, size_t Bytes) {
+        this->Out.write((const char*)Slots, Bytes);
+    }
+
+    void finish() {
+        this->Out.flush();
+        if(!this->Out)
+            throw std::runtime_error("Cannot write snapshot " + this->Path);
+        this->Out.close();
+    }
+};
+
+// A whole file mapped private and writable; unmapped on destruction
+class MappedFile {
+private:
+    char* Address;
+    size_t Length;
+
+public:
+    MappedFile() : Address(nullptr), Length(0) {}
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    MappedFile(MappedFile&& Other) : Address(Other.Address), Length(Other.Length) {
+        Other.Address = nullptr;
+        Other.Length = 0;
+    }
+
+    MappedFile& operator=(MappedFile&& Other) {
+        if(this != &Other) {
+            this->reset();
+            this->Address = Other.Address;
+            this->Length = Other.Length;
+            Other.Address = nullptr;
+            Other.Length = 0;
+        }
+        return *this;
+    }
+
+    ~MappedFile() {
+        this->reset();
+    }
+
+    void open(const std::string& Path) {
+        this->reset();
+        int Fd = ::open(Path.c_str(), O_RDONLY);
+        if(Fd < 0)
+            throw std::runtime_error("Cannot open snapshot " + Path);
+        struct stat Info;
+        if(fstat(Fd, &Info) != 0 || Info.st_size == 0) {
+            ::close(Fd);
+            throw std::runtime_error("Cannot map snapshot " + Path);
+        }
+        void* Memory = mmap(nullptr, Info.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, Fd, 0);
+        ::close(Fd);
+        if(Memory == MAP_FAILED)
+            throw std::runtime_error("Cannot map snapshot " + Path);
+        this->Address = (char*)Memory;
+        this->Length = Info.st_size;
+    }
+
+    void reset() {
+        if(this->Address != nullptr)
+            munmap(this->Address, this->Length);
+        this->Address = nullptr;
+        this->Length = 0;
+    }
+
+    char* data() {
+        return this->Address;
+    }
+
+    size_t size() const {
+        return this->Length;
+    }
+
+    // The header of the mapped snapshot, once it is known to match the
+    // layout in Expected. The check entry is left to the table, which
+    // knows how to hash it.
+    const SnapshotHeader& header(const SnapshotHeader& Expected) {
+        const SnapshotHeader* Header = (const SnapshotHeader*)this->Address;
+        if(this->Length < sizeof(SnapshotHeader) || memcmp(Header->Magic, Expected.Magic, 8) != 0)
+            throw std::runtime_error("Not a hash table snapshot");
+        if(Header->Version != Expected.Version || Header->ByteOrder != Expected.ByteOrder)
+            throw std::runtime_error("Snapshot version or byte order not supported");
+        if(Header->SlotSize != Expected.SlotSize || Header->ValueOffset != Expected.ValueOffset)
+            throw std::runtime_error("Snapshot was written for a different slot layout");
+        if(Header->SlotOffset % SNAPSHOT_ALIGN != 0 || Header->SlotOffset + Header->Capacity * Header->SlotSize > this->Length
+           || Header->CheckSlot > Header->Capacity || Header->Capacity == 0)
+            throw std::runtime_error("Snapshot is truncated");
+        return *Header;
+    }
+};
+
+#endif //__SNAPSHOT_H
@@ -0,0 +1,377 @@
+#pragma once
+
+#ifndef __STREAM_LOADER_H
+#define __STREAM_LOADER_H
+
+#include <vector>
+#include <deque>
+#include <algorithm>
+#include <string>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+#include <stdexcept>
+#include <type_traits>
+#include <cstdio>
+#include <cstring>
+#include <omp.h>
+
+//
+// Streaming bulk loader: key/value dump files into a table
+//
+//  Three stages run at once and hand work along bounded queues:
+//   reader    - the calling thread reads the file in ChunkBytes pieces
+//   parsers   - Parsers threads turn each chunk into a batch of keys and values
+//   inserters - Inserters threads hand each batch to the table's insert_batch
+//  so reading, parsing and inserting overlap. Chunks and batches come from
+//  fixed pools that go round the pipeline and are reused, so a load
+//  allocates nothing per record and the pools bound memory: a stage that
+//  falls behind stalls the ones feeding it.
+//
+//  Dumps are either text, one "key value" pair per line (separated by
+//  spaces, tabs or a comma; integer keys and values only), or binary,
+//  packed records of a raw K followed by a raw V. Batches are inserted in
+//  whatever order the parsers finish them.
+//
+//  ChainingHash and ProbingHash take one inserter; ParallelProbingHash can
+//  take several. Errors from any stage (an unreadable file, a malformed
+//  line) stop the pipeline and are rethrown from load() as
+//  std::runtime_error; whatever was inserted by then stays in the table.
+//
+enum DumpFormat { TEXT_DUMP, BINARY_DUMP };
+
+struct IngestConfig {
+    IngestConfig() : ChunkBytes(4 << 20), Parsers(2), Inserters(1), QueueDepth(4) {}
+    size_t ChunkBytes;  // bytes per read; a text line must fit in one
+    int Parsers;
+    int Inserters;      // more than one only for tables safe for concurrent inserts
+    int QueueDepth;     // chunks and batches waiting between stages
+};
+
+struct IngestResult {
+    IngestResult() : Bytes(0), Records(0), Seconds(0) {}
+    long Bytes;
+    long Records;
+    double Seconds;
+
+    double megabytes_per_second() const {
+        return this->Seconds > 0 ? this->Bytes / (1024.0 * 1024.0) / this->Seconds : 0;
+    }
+};
+
+// Queue of at most Capacity items. Once closed, push() refuses and pop()
+// drains what is left, then returns false.
+template<typename T>
+class BoundedQueue {
+private:
+    std::mutex Lock;
+    std::condition_variable NotEmpty;
+    std::condition_variable NotFull;
+    std::deque<T> Items;
+    size_t Capacity;
+    bool Closed;
+
+public:
+    explicit BoundedQueue(size_t capacity) : Capacity(capacity), Closed(false) {}
+
+    bool push(const T& Item) {
+        std::unique_lock<std::mutex> Guard(this->Lock);
+        while(this->Items.size() >= this->Capacity && !this->Closed)
+            this->NotFull.wait(Guard);
+        if(this->Closed)
+            return false;
+        this->Items.push_back(Item);
+        this->NotEmpty.notify_one();
+        return true;
+    }
+
+    bool pop(T& Item) {
+        std::unique_lock<std::mutex> Guard(this->Lock);
+        while(this->Items.empty() && !this->Closed)
+            this->NotEmpty.wait(Guard);
+        if(this->Items.empty())
+            return false;
+        Item = this->Items.front();
+        this->Items.pop_front();
+        this->NotFull.notify_one();
+        return true;
+    }
+
+    void close() {
+        std::lock_guard<std::mutex> Guard(this->Lock);
+        this->Closed = true;
+        this->NotEmpty.notify_all();
+        this->NotFull.notify_all();
+    }
+
+    // Empty and open again
+    void reset() {
+        std::lock_guard<std::mutex> Guard(this->Lock);
+        this->Items.clear();
+        this->Closed = false;
+    }
+};
+
+template<typename Table>
+class StreamLoader {
+private:
+    typedef typename Table::key_type K;
+    typedef typename Table::mapped_type V;
+
+    struct Chunk {
+        std::vector<char> Data;
+        size_t Length;
+        bool Last;
+    };
+
+    struct Batch {
+        std::vector<K> Keys;
+        std::vector<V> Values;
+    };
+
+    Table& Target;
+    IngestConfig Config;
+    DumpFormat Format;
+
+    std::vector<std::unique_ptr<Chunk>> Chunks;
+    std::vector<std::unique_ptr<Batch>> Batches;
+    BoundedQueue<Chunk*> FreeChunks;
+    BoundedQueue<Chunk*> FullChunks;
+    BoundedQueue<Batch*> FreeBatches;
+    BoundedQueue<Batch*> FullBatches;
+
+    std::mutex Lock;
+    std::exception_ptr Error;
+    int ParsersLeft;
+    long Records;
+
+public:
+    StreamLoader(Table& target, const IngestConfig& config = IngestConfig()) : Target(target), Config(normalized(config)), Format(TEXT_DUMP),
+        FreeChunks(pool(this->Config)), FullChunks(pool(this->Config)), FreeBatches(pool(this->Config)), FullBatches(pool(this->Config)),
+        ParsersLeft(0), Records(0) {
+        // Enough buffers to keep every stage busy and each queue full
+        for(size_t I = 0; I < pool(this->Config); I++) {
+            this->Chunks.emplace_back(new Chunk());
+            this->Chunks.back()->Data.resize(this->Config.ChunkBytes);
+            this->Batches.emplace_back(new Batch());
+        }
+    }
+
+    IngestResult load(const std::string& Path, DumpFormat format) {
+        double Start = omp_get_wtime();
+        this->Format = format;
+        this->Error = std::exception_ptr();
+        this->ParsersLeft = this->Config.Parsers;
+        this->Records = 0;
+        this->FreeChunks.reset();
+        this->FullChunks.reset();
+        this->FreeBatches.reset();
+        this->FullBatches.reset();
+        for(size_t I = 0; I < this->Chunks.size(); I++) {
+            this->FreeChunks.push(this->Chunks[I].get());
+            this->FreeBatches.push(this->Batches[I].get());
+        }
+
+        std::vector<std::thread> Workers;
+        for(int I = 0; I < this->Config.Parsers; I++)
+            Workers.push_back(std::thread(&StreamLoader::parseLoop, this));
+        for(int I = 0; I < this->Config.Inserters; I++)
+            Workers.push_back(std::thread(&StreamLoader::insertLoop, this));
+        IngestResult Result;
+        Result.Bytes = this->readLoop(Path);
+        for(size_t I = 0; I < Workers.size(); I++)
+            Workers[I].join();
+        if(this->Error)
+            std::rethrow_exception(this->Error);
+        Result.Records = this->Records;
+        Result.Seconds = omp_get_wtime() - Start;
+        return Result;
+    }
+
+private:
+    static IngestConfig normalized(IngestConfig config) {
+        config.Parsers = std::max(config.Parsers, 1);
+        config.Inserters = std::max(config.Inserters, 1);
+        config.QueueDepth = std::max(config.QueueDepth, 1);
+        return config;
+    }
+
+    static size_t pool(const IngestConfig& config) {
+        return (size_t)(config.QueueDepth + config.Parsers + config.Inserters + 1);
+    }
+
+    static size_t recordSize() {
+        return sizeof(K) + sizeof(V);
+    }
+
+    // Stops every stage; the first error wins
+    void fail(std::exception_ptr E) {
+        {
+            std::lock_guard<std::mutex> Guard(this->Lock);
+            if(!this->Error)
+                this->Error = E;
+        }
+        this->FreeChunks.close();
+        this->FullChunks.close();
+        this->FreeBatches.close();
+        this->FullBatches.close();
+    }
+
+    // Chunks end on a record boundary: a text chunk at its last newline (the
+    // rest is carried into the next chunk), a binary one on a whole record
+    long readLoop(const std::string& Path) {
+        long Bytes = 0;
+        try {
+            FILE* File = fopen(Path.c_str(), "rb");
+            if(File == nullptr)
+                throw std::runtime_error("Cannot open " + Path);
+            std::unique_ptr<FILE, int(*)(FILE*)> Closer(File, fclose);
+            size_t Step = this->Format == BINARY_DUMP ? recordSize() : 1;
+            size_t Capacity = this->Config.ChunkBytes / Step * Step;
+            if(Capacity == 0)
+                throw std::runtime_error("ChunkBytes is smaller than one record");
+            std::vector<char> Carry;
+            bool Done = false;
+            while(!Done) {
+                Chunk* C = nullptr;
+                if(!this->FreeChunks.pop(C))
+                    return Bytes;
+                if(!Carry.empty())
+                    memcpy(C->Data.data(), Carry.data(), Carry.size());
+                size_t Read = fread(C->Data.data() + Carry.size(), 1, Capacity - Carry.size(), File);
+                if(ferror(File))
+                    throw std::runtime_error("Cannot read " + Path);
+                Bytes += Read;
+                C->Length = Carry.size() + Read;
+                Done = C->Length < Capacity;
+                Carry.clear();
+                if(!Done) {
+                    size_t End = C->Length;
+                    if(this->Format == TEXT_DUMP) {
+                        while(End > 0 && C->Data[End - 1] != '\n')
+                            End--;
+                        if(End == 0)
+                            throw std::runtime_error("Line longer than ChunkBytes in " + Path);
+                    }
+                    Carry.assign(C->Data.data() + End, C->Data.data() + C->Length);
+                    C->Length = End;
+                }
+                else if(C->Length % Step != 0) {
+                    throw std::runtime_error("Truncated record at the end of " + Path);
+                }
+                C->Last = Done;
+                if(!this->FullChunks.push(C))
+                    return Bytes;
+            }
+        }
+        catch(...) {
+            this->fail(std::current_exception());
+        }
+        this->FullChunks.close();
+        return Bytes;
+    }
+
+    void parseLoop() {
+        try {
+            Chunk* C = nullptr;
+            while(this->FullChunks.pop(C)) {
+                Batch* B = nullptr;
+                if(!this->FreeBatches.pop(B))
+                    break;
+                B->Keys.clear();
+                B->Values.clear();
+                if(this->Format == BINARY_DUMP)
+                    this->parseBinary(*C, *B);
+                else
+                    this->parseText(*C, *B, std::integral_constant<bool, std::is_integral<K>::value && std::is_integral<V>::value>());
+                this->FreeChunks.push(C);
+                if(!this->FullBatches.push(B))
+                    break;
+            }
+        }
+        catch(...) {
+            this->fail(std::current_exception());
+        }
+        std::lock_guard<std::mutex> Guard(this->Lock);
+        if(--this->ParsersLeft == 0)
+            this->FullBatches.close();
+    }
+
+    void insertLoop() {
+        try {
+            Batch* B = nullptr;
+            while(this->FullBatches.pop(B)) {
+                this->Target.insert_batch(B->Keys.data(), B->Values.data(), B->Keys.size());
+                {
+                    std::lock_guard<std::mutex> Guard(this->Lock);
+                    this->Records += B->Keys.size();
+                }
+                this->FreeBatches.push(B);
+            }
+        }
+        catch(...) {
+            this->fail(std::current_exception());
+        }
+    }
+
+    void parseBinary(const Chunk& C, Batch& B) {
+        size_t Count = C.Length / recordSize();
+        B.Keys.resize(Count);
+        B.Values.resize(Count);
+        const char* Record = C.Data.data();
+        for(size_t I = 0; I < Count; I++, Record += recordSize()) {
+            memcpy(&B.Keys[I], Record, sizeof(K));
+            memcpy(&B.Values[I], Record + sizeof(K), sizeof(V));
+        }
+    }
+
+    void parseText(const Chunk&, Batch&, std::false_type) {
+        throw std::runtime_error("Text dumps need integer keys and values");
+    }
+
+    void parseText(const Chunk& C, Batch& B, std::true_type) {
+        const char* At = C.Data.data();
+        const char* End = At + C.Length;
+        while(At < End) {
+            At = skipBlanks(At, End);
+            if(At == End)
+                break;
+            if(*At == '\n') {
+                At++;
+                continue;
+            }
+            long long Key = 0;
+            long long Value = 0;
+            At = parseInteger(At, End, Key);
+            At = parseInteger(skipBlanks(At, End), End, Value);
+            At = skipBlanks(At, End);
+            if(At < End && *At != '\n')
+                throw std::runtime_error("Expected \"key value\" on every line");
+            B.Keys.push_back((K)Key);
+            B.Values.push_back((V)Value);
+        }
+    }
+
+    static const char* skipBlanks(const char* At, const char* End) {
+        while(At < End && (*At == ' ' || *At == '\t' || *At == ',' || *At == '\r'))
+            At++;
+        return At;
+    }
+
+    static const char* parseInteger(const char* At, const char* End, long long& Out) {
+        bool Negative = At < End && *At == '-';
+        if(Negative || (At < End && *At == '+'))
+            At++;
+        if(At == End || *At < '0' || *At > '9')
+            throw std::runtime_error("Expected \"key value\" on every line");
+        unsigned long long Value = 0;
+        while(At < End && *At >= '0' && *At <= '9')
+            Value = Value * 10 + (*At++ - '0');
+        Out = Negative ? -(long long)Value : (long long)Value;
+        return At;
+    }
+};
+
+#endif //__STREAM_LOADER_H
@@ -0,0 +1,368 @@
+#pragma once
+
+#ifndef __STRING_HASH_H
+#define __STRING_HASH_H
+
+#include <string>
+#include <memory>
+#include <utility>
+#include <cstring>
+#include <cstdint>
+#include <algorithm>
+#include <stdexcept>
+
+#include "Hash.hpp"
+#include "HashFunctions.hpp"
+#include "HashStats.hpp"
+#include "SlotLayout.hpp"
+#include "SlotVector.hpp"
+#include "StringView.hpp"
+
+//
+// Linear probing hash table keyed by std::string - implements Hash (via StaticHash)
+//
+//  The other tables keep only a V and find it by comparing it against the
+//  key, so they cannot map a string to anything but itself. Here every slot
+//  holds a key, a value and the key's full hash. A probe compares the hash
+//  and the length before it touches the bytes, so passing over another key
+//  almost never costs a memcmp, and growing places every entry by its stored
+//  hash without hashing a key again.
+//
+//  Keys of up to INLINE_KEY bytes (symbols, short IDs) live in the slot
+//  itself; a longer key is copied into a buffer from Allocator and the slot
+//  keeps a pointer to it. at(), count(), erase(), bucket() and try_emplace()
+//  take a StringView (see StringView.hpp), so a lookup from a char buffer or
+//  a std::string_view builds no std::string.
+//
+//  Growth follows SizePolicy and max_load_factor() as in ProbingHash. Erase
+//  leaves DELETED tombstones, which count toward the load; when they make
+//  up most of it the table is rebuilt at the same size instead of growing.
+//  The table owns raw key buffers, so it cannot be copied.
+//
+template<typename V, typename Hasher = BytesHash, typename SizePolicy = PrimeSize, typename Allocator = std::allocator<V>>
+class StringHash : public StaticHash<StringHash<V, Hasher, SizePolicy, Allocator>, std::string, V> {
+private:
+    template<typename> friend class HashAdapter;
+
+    enum { INLINE_KEY = 23 };
+
+    struct Entry {
+        enum { ZERO_INITIALIZABLE = EMPTY == 0 && ZeroInitializable<V>::value };
+
+        Entry() : Hash(0), Length(0), State(EMPTY), Value() {}
+
+        uint64_t Hash;
+        uint32_t Length;
+        uint8_t State;
+        // The key, or a pointer to it once it is longer than INLINE_KEY
+        char Key[INLINE_KEY];
+        V Value;
+
+        const char* key() const {
+            if(this->Length <= INLINE_KEY)
+                return this->Key;
+            const char* Heap;
+            memcpy(&Heap, this->Key, sizeof(Heap));
+            return Heap;
+        }
+    };
+
+    typedef typename std::allocator_traits<Allocator>::template rebind_alloc<char> KeyAllocator;
+    typedef std::allocator_traits<KeyAllocator> KeyTraits;
+
+    SlotVector<Entry, Allocator> Table;
+    int numElements;
+    int numDeleted;
+    float MaxLoad;
+    Hasher HashFunction;
+    KeyAllocator Keys;
+    HASH_STATS_ONLY(StatsCounters Counters;)
+
+public:
+    StringHash(int n = 11) {
+        this->Table.reset(SizePolicy::size(n));
+        this->numElements = 0;
+        this->numDeleted = 0;
+        this->MaxLoad = .75;
+    }
+
+    StringHash(const StringHash&) = delete;
+    StringHash& operator=(const StringHash&) = delete;
+
+    ~StringHash() {
+        this->releaseKeys();
+    }
+
+    bool empty() {
+        return this->numElements == 0;
+    }
+
+    int size() {
+        return this->numElements;
+    }
+
+    V& at(StringView key) {
+        int Index = this->find(key, this->hash(key));
+        if(Index < 0)
+            throw std::out_of_range("Key not in hash");
+        return this->Table[Index].Value;
+    }
+
+    // Hides StaticHash's, which would build a std::string from a literal
+    V& operator[](StringView key) {
+        return this->at(key);
+    }
+
+    int count(StringView key) {
+        uint64_t Hash = this->hash(key);
+        int Size = 0;
+        long unsigned int Index = this->home(Hash, this->Table.size());
+        long unsigned int I = 0;
+        HASH_STATS_ONLY(long unsigned int First = 0;)
+        for(; I < this->Table.size(); I++) {
+            if(this->Table[Index].State == EMPTY)
+                break;
+            if(this->matches(this->Table[Index], key, Hash)) {
+                HASH_STATS_ONLY(if(Size == 0) First = I + 1;)
+                Size += 1;
+            }
+            if(++Index == this->Table.size())
+                Index = 0;
+        }
+        HASH_STATS_ONLY(if(Size > 0) this->Counters.hit(First); else this->Counters.miss(std::min(I + 1, this->Table.size()));)
+        return Size;
+    }
+
+    void emplace(std::string key, V value) {
+        this->add(key, this->hash(key), std::move(value));
+    }
+
+    // Inserts V(args...) unless key is already in the table; returns
+    // whether it did. The key is hashed once for both steps, and the value
+    // is constructed in its slot (see constructInPlace() in Hash.hpp).
+    template<typename... Args>
+    bool try_emplace(StringView key, Args&&... args) {
+        uint64_t Hash = this->hash(key);
+        if(this->find(key, Hash) >= 0)
+            return false;
+        this->add(key, Hash, std::forward<Args>(args)...);
+        return true;
+    }
+
+    void erase(StringView key) {
+        uint64_t Hash = this->hash(key);
+        long unsigned int Index = this->home(Hash, this->Table.size());
+        for(long unsigned int I = 0; I < this->Table.size(); I++) {
+            Entry& E = this->Table[Index];
+            if(E.State == EMPTY)
+                break;
+            if(this->matches(E, key, Hash)) {
+                this->freeKey(E);
+                E.State = DELETED;
+                E.Value = V();
+                this->numElements -= 1;
+                this->numDeleted += 1;
+            }
+            if(++Index == this->Table.size())
+                Index = 0;
+        }
+    }
+
+    void clear() {
+        this->releaseKeys();
+        this->Table.reset(this->Table.size());
+        this->numElements = 0;
+        this->numDeleted = 0;
+    }
+
+    int bucket_count() {
+        return this->Table.size();
+    }
+
+    int bucket_size(int n) {
+        if(this->Table[n].State == VALID)
+            return 1;
+        return 0;
+    }
+
+    int bucket(StringView key) {
+        int Index = this->find(key, this->hash(key));
+        if(Index < 0)
+            throw std::out_of_range("Key not in hash");
+        return Index;
+    }
+
+    float load_factor() {
+        return (float)this->numElements / (float)this->Table.size();
+    }
+
+    void rehash() {
+        this->resize(SizePolicy::grow(this->Table.size()));
+    }
+
+    void rehash(int n) {
+        this->resize(SizePolicy::size(n));
+    }
+
+    float max_load_factor() {
+        return this->MaxLoad;
+    }
+
+    // Probes end at an EMPTY slot, so f stays below 1; the table grows right
+    // away if it is already above f
+    void max_load_factor(float f) {
+        if(!(f > 0 && f < 1))
+            throw std::invalid_argument("Max load factor must be between 0 and 1");
+        this->MaxLoad = f;
+        this->reserve(this->numElements);
+    }
+
+    // Makes room for n elements, so inserting up to n never rehashes
+    void reserve(int n) {
+        if(n + this->numDeleted > (double)this->MaxLoad * this->Table.size())
+            this->rehash((int)(n / (double)this->MaxLoad) + 1);
+    }
+
+    // Longest run of non-EMPTY slots and the tombstone share, plus the
+    // probe histograms and rehash counters when built with HASH_STATS
+    HashStats stats() {
+        HashStats Stats;
+        Stats.MaxCluster = longestRun(this->Table.size(), [&](long unsigned int I) { return this->Table[I].State != EMPTY; });
+        Stats.Tombstones = this->numDeleted;
+        Stats.TombstoneRatio = (float)this->numDeleted / (float)this->Table.size();
+        HASH_STATS_ONLY(this->Counters.fill(Stats);)
+        return Stats;
+    }
+
+private:
+    // Grows before placing, so the probe always finds an EMPTY slot to stop
+    // at. args may refer into the table, so the value is built before growing.
+    template<typename... Args>
+    void add(StringView key, uint64_t Hash, Args&&... args) {
+        if(this->numElements + this->numDeleted + 1 > (double)this->MaxLoad * this->Table.size()) {
+            V Value(std::forward<Args>(args)...);
+            this->grow();
+            this->place(key, Hash, std::move(Value));
+        }
+        else {
+            this->place(key, Hash, std::forward<Args>(args)...);
+        }
+    }
+
+    // The value goes first, so a constructor that throws leaves no key buffer behind
+    template<typename... Args>
+    void place(StringView key, uint64_t Hash, Args&&... args) {
+        Entry& E = this->Table[this->nextFree(this->Table, this->home(Hash, this->Table.size()))];
+        constructInPlace(E.Value, std::forward<Args>(args)...);
+        this->storeKey(E, key);
+        if(E.State == DELETED)
+            this->numDeleted -= 1;
+        E.Hash = Hash;
+        E.State = VALID;
+        this->numElements += 1;
+    }
+
+    int home(uint64_t Hash, long unsigned int Size) {
+        return SizePolicy::index((size_t)Hash, Size);
+    }
+
+    bool matches(const Entry& E, StringView key, uint64_t Hash) {
+        return E.State == VALID && E.Hash == Hash && E.Length == key.size()
+               && (key.size() == 0 || memcmp(E.key(), key.data(), key.size()) == 0);
+    }
+
+    // Index of the valid slot holding key, or -1 once an EMPTY slot ends the probe
+    int find(StringView key, uint64_t Hash) {
+        long unsigned int Index = this->home(Hash, this->Table.size());
+        for(long unsigned int I = 0; I < this->Table.size(); I++) {
+            if(this->Table[Index].State == EMPTY) {
+                HASH_STATS_ONLY(this->Counters.miss(I + 1);)
+                return -1;
+            }
+            if(this->matches(this->Table[Index], key, Hash)) {
+                HASH_STATS_ONLY(this->Counters.hit(I + 1);)
+                return Index;
+            }
+            if(++Index == this->Table.size())
+                Index = 0;
+        }
+        HASH_STATS_ONLY(this->Counters.miss(this->Table.size());)
+        return -1;
+    }
+
+    // First slot from Index on that is not VALID
+    static long unsigned int nextFree(SlotVector<Entry, Allocator>& Slots, long unsigned int Index) {
+        while(Slots[Index].State == VALID) {
+            if(++Index == Slots.size())
+                Index = 0;
+        }
+        return Index;
+    }
+
+    // Copies key into E, inline or into a buffer of its own
+    void storeKey(Entry& E, StringView key) {
+        if(key.size() > UINT32_MAX)
+            throw std::length_error("Key too long for StringHash");
+        if(key.size() > INLINE_KEY) {
+            char* Heap = KeyTraits::allocate(this->Keys, key.size());
+            memcpy(Heap, key.data(), key.size());
+            memcpy(E.Key, &Heap, sizeof(Heap));
+        }
+        else if(key.size() > 0) {
+            memcpy(E.Key, key.data(), key.size());
+        }
+        E.Length = (uint32_t)key.size();
+    }
+
+    void freeKey(Entry& E) {
+        if(E.Length > INLINE_KEY)
+            KeyTraits::deallocate(this->Keys, (char*)E.key(), E.Length);
+        E.Length = 0;
+    }
+
+    void releaseKeys() {
+        for(long unsigned int I = 0; I < this->Table.size(); I++) {
+            if(this->Table[I].State == VALID)
+                this->freeKey(this->Table[I]);
+        }
+    }
+
+    // Mostly tombstones: clean them out at the same size rather than grow
+    void grow() {
+        if(this->numDeleted > this->numElements)
+            this->resize(this->Table.size());
+        else
+            this->resize(SizePolicy::grow(this->Table.size()));
+    }
+
+    // Entries move with their cached hash and key buffer; no key is hashed
+    // or copied again. Never goes below what the elements need.
+    void resize(int nSize) {
+        int Minimum = SizePolicy::size((int)((this->numElements + 1) / (double)this->MaxLoad) + 1);
+        if(nSize < Minimum)
+            nSize = Minimum;
+        HASH_STATS_ONLY(this->Counters.rehash(); StatsCounters::Timer RehashTimer(this->Counters);)
+        SlotVector<Entry, Allocator> nTable;
+        nTable.reset(nSize);
+        for(long unsigned int I = 0; I < this->Table.size(); I++) {
+            Entry& E = this->Table[I];
+            if(E.State != VALID)
+                continue;
+            Entry& N = nTable[this->nextFree(nTable, this->home(E.Hash, nSize))];
+            N.Hash = E.Hash;
+            N.Length = E.Length;
+            memcpy(N.Key, E.Key, INLINE_KEY);
+            N.Value = std::move(E.Value);
+            N.State = VALID;
+        }
+        this->Table.swap(nTable);
+        this->numDeleted = 0;
+    }
+
+    uint64_t hash(StringView key) {
+        return this->HashFunction(key);
+    }
+
+};
+
+#endif //__STRING_HASH_H
@@ -0,0 +1,67 @@
+#pragma once
+
+#ifndef __STRING_VIEW_H
+#define __STRING_VIEW_H
+
+#include <string>
+#include <cstring>
+#include <cstddef>
+
+//
+// Borrowed string keys for lookups
+//
+//  StringHash (see StringHash.hpp) looks keys up through a StringView, so a
+//  caller holding a char buffer, a literal or a slice of a larger string
+//  never has to build a std::string first. With C++17 this is
+//  std::string_view; C++11 builds get the few members the tables use.
+//
+#if __cplusplus >= 201703L
+
+#include <string_view>
+
+typedef std::string_view StringView;
+
+#else
+
+class StringView {
+private:
+    const char* Data;
+    size_t Length;
+
+public:
+    StringView() : Data(nullptr), Length(0) {}
+
+    StringView(const char* s) : Data(s), Length(std::strlen(s)) {}
+
+    StringView(const char* s, size_t n) : Data(s), Length(n) {}
+
+    StringView(const std::string& s) : Data(s.data()), Length(s.size()) {}
+
+    const char* data() const {
+        return this->Data;
+    }
+
+    size_t size() const {
+        return this->Length;
+    }
+
+    bool empty() const {
+        return this->Length == 0;
+    }
+
+    explicit operator std::string() const {
+        return std::string(this->Data, this->Length);
+    }
+};
+
+inline bool operator==(StringView a, StringView b) {
+    return a.size() == b.size() && (a.size() == 0 || std::memcmp(a.data(), b.data(), a.size()) == 0);
+}
+
+inline bool operator!=(StringView a, StringView b) {
+    return !(a == b);
+}
+
+#endif
+
+#endif //__STRING_VIEW_H
@@ -0,0 +1,376 @@
+#pragma once
+
+#ifndef __SWISS_HASH_H
+#define __SWISS_HASH_H
+
+#include <vector>
+#include <cstdint>
+#include <utility>
+#include <stdexcept>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#include "Hash.hpp"
+#include "HashFunctions.hpp"
+#include "HashStats.hpp"
+
+//
+// SwissTable-style open addressing hash table - implements Hash (via StaticHash)
+//
+//  Slot states live in their own array of one-byte control words, apart from
+//  the values. A control word is EMPTY, DELETED, or the low 7 bits of the
+//  key's hash (H2) for a full slot. The table is split into groups of
+//  GROUP_SIZE slots (16 with SSE2, 32 with AVX2) and probes go group by
+//  group: one compare matches H2 against the whole group, and only slots
+//  whose fingerprint matches have their value loaded. A group with an EMPTY
+//  control word ends a failed lookup. The remaining hash bits (H1) pick the
+//  first group; later groups follow a triangular sequence, which visits
+//  every group because the group count is a power of two.
+//
+//  Erasing leaves a DELETED marker only if the group has no other EMPTY
+//  slot. If it has one, no probe has ever had to continue past the group,
+//  so the slot can go straight back to EMPTY.
+//
+template<typename K, typename V, typename Hasher = MixHash<K>>
+class SwissHash : public StaticHash<SwissHash<K, V, Hasher>, K, V> {
+private:
+    template<typename> friend class HashAdapter;
+
+#if defined(__AVX2__)
+    enum { GROUP_SIZE = 32 };
+#else
+    enum { GROUP_SIZE = 16 };
+#endif
+
+    enum : int8_t {
+        CTRL_EMPTY = -128,  // 0b10000000
+        CTRL_DELETED = -2   // 0b11111110
+    };
+
+    std::vector<int8_t> Ctrl;
+    std::vector<V> Slots;
+    int numElements;
+    int numDeleted;
+    // Share of the slots that may be full (counting DELETED markers)
+    // before growing, 7/8 by default
+    float MaxLoad;
+    int GroupMask;
+    Hasher HashFunction;
+    HASH_STATS_ONLY(StatsCounters Counters;)
+
+public:
+    SwissHash(int n = 11) {
+        this->MaxLoad = .875f;
+        this->allocate(this->capacityFor(n));
+    }
+
+    ~SwissHash() {
+    }
+
+    bool empty() {
+        return this->numElements == 0;
+    }
+
+    int size() {
+        return this->numElements;
+    }
+
+    V& at(const K& key) {
+        int Index = this->find(key);
+        if(Index < 0)
+            throw std::out_of_range("Key not in hash");
+        return this->Slots[Index];
+    }
+
+    int count(const K& key) {
+        int Size = 0;
+        size_t H = this->hash(key);
+        int8_t H2 = h2(H);
+        int Group = h1(H) & this->GroupMask;
+        int Step = 1;
+        HASH_STATS_ONLY(int First = 0;)
+        for(; Step <= this->GroupMask + 1; Step++) {
+            int Base = Group * GROUP_SIZE;
+            for(uint32_t Match = this->match(Base, H2); Match != 0; Match &= Match - 1) {
+                if(this->Slots[Base + lowestBit(Match)] == key) {
+                    HASH_STATS_ONLY(if(Size == 0) First = Step;)
+                    Size += 1;
+                }
+            }
+            if(this->matchEmpty(Base) != 0)
+                break;
+            Group = (Group + Step) & this->GroupMask;
+        }
+        // A hit is charged up to its first match, what find() would pay
+        HASH_STATS_ONLY(if(Size > 0) this->Counters.hit(First); else this->Counters.miss(std::min(Step, this->GroupMask + 1));)
+        return Size;
+    }
+
+    void emplace(K key, V value) {
+        this->add(key, std::move(value));
+    }
+
+    // Inserts V(args...) unless key is already in the table; returns
+    // whether it did. The value is constructed in its slot (see
+    // constructInPlace() in Hash.hpp), and the key is never stored.
+    template<typename... Args>
+    bool try_emplace(const K& key, Args&&... args) {
+        if(this->find(key) >= 0)
+            return false;
+        this->add(key, std::forward<Args>(args)...);
+        return true;
+    }
+
+    void erase(const K& key) {
+        size_t H = this->hash(key);
+        int8_t H2 = h2(H);
+        int Group = h1(H) & this->GroupMask;
+        for(int Step = 1; Step <= this->GroupMask + 1; Step++) {
+            int Base = Group * GROUP_SIZE;
+            bool HasEmpty = this->matchEmpty(Base) != 0;
+            for(uint32_t Match = this->match(Base, H2); Match != 0; Match &= Match - 1) {
+                int Index = Base + lowestBit(Match);
+                if(this->Slots[Index] == key) {
+                    if(HasEmpty) {
+                        this->Ctrl[Index] = CTRL_EMPTY;
+                    }
+                    else {
+                        this->Ctrl[Index] = CTRL_DELETED;
+                        this->numDeleted += 1;
+                    }
+                    this->numElements -= 1;
+                }
+            }
+            if(HasEmpty)
+                break;
+            Group = (Group + Step) & this->GroupMask;
+        }
+    }
+
+    void clear() {
+        this->Ctrl.assign(this->Ctrl.size(), CTRL_EMPTY);
+        this->numElements = 0;
+        this->numDeleted = 0;
+    }
+
+    int bucket_count() {
+        return this->capacity();
+    }
+
+    int bucket_size(int n) {
+        if(this->Ctrl[n] >= 0)
+            return 1;
+        return 0;
+    }
+
+    int bucket(const K& key) {
+        int Index = this->find(key);
+        if(Index < 0)
+            throw std::out_of_range("Key not in hash");
+        return Index;
+    }
+
+    float load_factor() {
+        return (float)this->numElements / (float)this->capacity();
+    }
+
+    void rehash() {
+        this->resize(2 * this->capacity());
+    }
+
+    void rehash(int n) {
+        this->resize(this->capacityFor(n));
+    }
+
+    float max_load_factor() {
+        return this->MaxLoad;
+    }
+
+    // Every probe sequence needs a group with an EMPTY slot to end in, so f
+    // stays below 1; the table grows right away if it is already above f.
+    // Capacities stay powers of two, so growing always doubles.
+    void max_load_factor(float f) {
+        if(!(f > 0 && f < 1))
+            throw std::invalid_argument("Max load factor must be between 0 and 1");
+        this->MaxLoad = f;
+        this->reserve(this->numElements + this->numDeleted);
+    }
+
+    // Makes room for n elements; tombstones left by erase still count
+    // against it until the next rehash clears them
+    void reserve(int n) {
+        if(n > (double)this->MaxLoad * this->capacity())
+            this->resize(this->capacityFor((int)(n / (double)this->MaxLoad) + 1));
+    }
+
+    // Longest run of non-EMPTY slots and the tombstone share, plus the
+    // probe histograms (in groups visited) and rehash counters when built
+    // with HASH_STATS
+    HashStats stats() {
+        HashStats Stats;
+        Stats.MaxCluster = longestRun(this->Ctrl.size(), [&](long unsigned int I) { return this->Ctrl[I] != CTRL_EMPTY; });
+        Stats.Tombstones = this->numDeleted;
+        Stats.TombstoneRatio = (float)this->numDeleted / (float)this->capacity();
+        HASH_STATS_ONLY(this->Counters.fill(Stats);)
+        return Stats;
+    }
+
+private:
+    // Places before it grows, so args may still refer into the table. The
+    // table stays under the load factor after every insert, so a free slot
+    // is always there. The control word is written once the value is built.
+    template<typename... Args>
+    void add(const K& key, Args&&... args) {
+        size_t H = this->hash(key);
+        int Index = this->findFree(H);
+        constructInPlace(this->Slots[Index], std::forward<Args>(args)...);
+        if(this->Ctrl[Index] == CTRL_DELETED)
+            this->numDeleted -= 1;
+        this->Ctrl[Index] = h2(H);
+        this->numElements += 1;
+        if(this->numElements + this->numDeleted > this->MaxLoad * this->capacity())
+            this->grow();
+    }
+
+    static int8_t h2(size_t H) {
+        return (int8_t)(H & 0x7F);
+    }
+
+    static int h1(size_t H) {
+        return (int)(H >> 7);
+    }
+
+    static int lowestBit(uint32_t Mask) {
+        return __builtin_ctz(Mask);
+    }
+
+    int capacity() {
+        return (int)this->Ctrl.size();
+    }
+
+    // Smallest power-of-two number of groups holding n slots
+    static int capacityFor(int n) {
+        int Capacity = GROUP_SIZE;
+        while(Capacity < n)
+            Capacity <<= 1;
+        return Capacity;
+    }
+
+    void allocate(int Capacity) {
+        this->Ctrl.assign(Capacity, CTRL_EMPTY);
+        this->Slots.assign(Capacity, V());
+        this->GroupMask = Capacity / GROUP_SIZE - 1;
+        this->numElements = 0;
+        this->numDeleted = 0;
+    }
+
+    // Bit i is set when slot Base + i holds fingerprint H2
+    uint32_t match(int Base, int8_t H2) {
+#if defined(__AVX2__)
+        __m256i Group = _mm256_loadu_si256((const __m256i*)&this->Ctrl[Base]);
+        return (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(Group, _mm256_set1_epi8(H2)));
+#elif defined(__SSE2__)
+        __m128i Group = _mm_loadu_si128((const __m128i*)&this->Ctrl[Base]);
+        return (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(Group, _mm_set1_epi8(H2)));
+#else
+        uint32_t Mask = 0;
+        for(int I = 0; I < GROUP_SIZE; I++) {
+            if(this->Ctrl[Base + I] == H2)
+                Mask |= 1u << I;
+        }
+        return Mask;
+#endif
+    }
+
+    uint32_t matchEmpty(int Base) {
+        return this->match(Base, CTRL_EMPTY);
+    }
+
+    // EMPTY and DELETED are the only control words with the sign bit set
+    uint32_t matchFree(int Base) {
+#if defined(__AVX2__)
+        return (uint32_t)_mm256_movemask_epi8(_mm256_loadu_si256((const __m256i*)&this->Ctrl[Base]));
+#elif defined(__SSE2__)
+        return (uint32_t)_mm_movemask_epi8(_mm_loadu_si128((const __m128i*)&this->Ctrl[Base]));
+#else
+        uint32_t Mask = 0;
+        for(int I = 0; I < GROUP_SIZE; I++) {
+            if(this->Ctrl[Base + I] < 0)
+                Mask |= 1u << I;
+        }
+        return Mask;
+#endif
+    }
+
+    int find(const K& key) {
+        size_t H = this->hash(key);
+        int8_t H2 = h2(H);
+        int Group = h1(H) & this->GroupMask;
+        for(int Step = 1; Step <= this->GroupMask + 1; Step++) {
+            int Base = Group * GROUP_SIZE;
+            for(uint32_t Match = this->match(Base, H2); Match != 0; Match &= Match - 1) {
+                int Index = Base + lowestBit(Match);
+                if(this->Slots[Index] == key) {
+                    HASH_STATS_ONLY(this->Counters.hit(Step);)
+                    return Index;
+                }
+            }
+            if(this->matchEmpty(Base) != 0) {
+                HASH_STATS_ONLY(this->Counters.miss(Step);)
+                return -1;
+            }
+            Group = (Group + Step) & this->GroupMask;
+        }
+        HASH_STATS_ONLY(this->Counters.miss(this->GroupMask + 1);)
+        return -1;
+    }
+
+    // First EMPTY or DELETED slot on the probe sequence of hash H
+    int findFree(size_t H) {
+        int Group = h1(H) & this->GroupMask;
+        for(int Step = 1; ; Step++) {
+            int Base = Group * GROUP_SIZE;
+            uint32_t Free = this->matchFree(Base);
+            if(Free != 0)
+                return Base + lowestBit(Free);
+            Group = (Group + Step) & this->GroupMask;
+        }
+    }
+
+    // Mostly tombstones: clean them out at the same size, otherwise double
+    void grow() {
+        if(this->numDeleted * 2 > this->numElements)
+            this->resize(this->capacity());
+        else
+            this->resize(2 * this->capacity());
+    }
+
+    void resize(int Capacity) {
+        if((double)this->MaxLoad * Capacity < this->numElements + 1)
+            Capacity = this->capacityFor((int)((this->numElements + 1) / (double)this->MaxLoad) + 1);
+        HASH_STATS_ONLY(this->Counters.rehash(); StatsCounters::Timer RehashTimer(this->Counters);)
+        std::vector<int8_t> OldCtrl;
+        std::vector<V> OldSlots;
+        OldCtrl.swap(this->Ctrl);
+        OldSlots.swap(this->Slots);
+        this->allocate(Capacity);
+        for(long unsigned int I = 0; I < OldCtrl.size(); I++) {
+            if(OldCtrl[I] >= 0) {
+                size_t H = this->hash(OldSlots[I]);
+                int Index = this->findFree(H);
+                this->Ctrl[Index] = h2(H);
+                this->Slots[Index] = std::move(OldSlots[I]);
+                this->numElements += 1;
+            }
+        }
+    }
+
+    size_t hash(const K& key) {
+        return this->HashFunction(key);
+    }
+
+};
+
+#endif //__SWISS_HASH_H
@@ -0,0 +1,110 @@
+#pragma once
+
+#ifndef __WRITE_BUFFER_H
+#define __WRITE_BUFFER_H
+
+#include <vector>
+#include <cstddef>
+
+//
+// Per-thread write combining in front of a shared table
+//
+//  A WriteBuffer belongs to one thread. emplace() and erase() only append to
+//  its private list, touching no shared cache line; once Threshold writes
+//  are waiting, or on sync(), the whole list goes to the table's
+//  merge_writes(), which applies it in order of home slot so the table is
+//  walked front to back instead of at random. Writes to the same key keep
+//  their order. The table does not see a write until it is merged, and the
+//  destructor merges whatever is left.
+//
+//  count() and find() here see the thread's own pending writes on top of
+//  the table. They scan the pending list, so they cost O(pending); readers
+//  that do not need their own writes should ask the table directly.
+//
+template<typename K, typename V>
+struct PendingWrite {
+    K Key;
+    V Value;
+    bool Erase;
+    unsigned Home;  // filled in by merge_writes
+};
+
+template<typename Table>
+class WriteBuffer {
+private:
+    typedef typename Table::key_type K;
+    typedef typename Table::mapped_type V;
+
+    Table& Target;
+    std::vector<PendingWrite<K, V>> Pending;
+    size_t Threshold;
+
+public:
+    explicit WriteBuffer(Table& target, size_t threshold = 4096) : Target(target), Threshold(threshold < 1 ? 1 : threshold) {
+        this->Pending.reserve(this->Threshold);
+    }
+
+    WriteBuffer(const WriteBuffer&) = delete;
+    WriteBuffer& operator=(const WriteBuffer&) = delete;
+
+    ~WriteBuffer() {
+        this->sync();
+    }
+
+    void emplace(K key, V value) {
+        PendingWrite<K, V> Write = { std::move(key), std::move(value), false, 0 };
+        this->append(std::move(Write));
+    }
+
+    void erase(const K& key) {
+        PendingWrite<K, V> Write = { key, V(), true, 0 };
+        this->append(std::move(Write));
+    }
+
+    // Merges every pending write into the table
+    void sync() {
+        if(this->Pending.empty())
+            return;
+        this->Target.merge_writes(this->Pending);
+        this->Pending.clear();
+    }
+
+    size_t pending() const {
+        return this->Pending.size();
+    }
+
+    // The table's count with this thread's pending writes played over it:
+    // an insert adds one, an erase removes every entry for the key
+    int count(const K& key) {
+        int Count = this->Target.count(key);
+        for(size_t I = 0; I < this->Pending.size(); I++) {
+            if(this->Pending[I].Key == key)
+                Count = this->Pending[I].Erase ? 0 : Count + 1;
+        }
+        return Count;
+    }
+
+    // Copies the value for key into value. The newest pending write for key
+    // decides if there is one; otherwise the table's find() does, which
+    // copies under the table's own guard.
+    bool find(const K& key, V& value) {
+        for(size_t I = this->Pending.size(); I-- > 0;) {
+            if(this->Pending[I].Key != key)
+                continue;
+            if(this->Pending[I].Erase)
+                return false;
+            value = this->Pending[I].Value;
+            return true;
+        }
+        return this->Target.find(key, value);
+    }
+
+private:
+    void append(PendingWrite<K, V>&& Write) {
+        this->Pending.push_back(std::move(Write));
+        if(this->Pending.size() >= this->Threshold)
+            this->sync();
+    }
+};
+
+#endif //__WRITE_BUFFER_H
@@ -0,0 +1,104 @@
+/*
+	Benchmark driver: runs every table against a set of workloads and writes
+	the results to CSV and JSON (see Benchmark.hpp).
+
+	./bench [--preload N] [--ops N] [--reps N] [--warmup N] [--threads N]
+	        [--skew S] [--table NAME] [--workload NAME] [--csv FILE] [--json FILE]
+
+	--table and --workload may be given more than once to pick a subset.
+*/
+
+#include "ChainingHash.hpp"
+#include "ProbingHash.hpp"
+#include "ParallelProbingHash.hpp"
+#include "SwissHash.hpp"
+#include "RobinHoodHash.hpp"
+#include "BucketChainingHash.hpp"
+#include "CuckooHash.hpp"
+#include "HugePageAllocator.hpp"
+#include "Benchmark.hpp"
+
+#include <omp.h>
+#include <cstdlib>
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <vector>
+
+static bool selected(const std::vector<std::string>& Names, const std::string& Name)
+{
+	return Names.empty() || std::find(Names.begin(), Names.end(), Name) != Names.end();
+}
+
+int main(int argc, char** argv)
+{
+	BenchmarkConfig Config;
+	Config.MaxThreads = omp_get_max_threads();
+	std::string CsvPath = "bench.csv";
+	std::string JsonPath = "bench.json";
+	std::vector<std::string> Tables;
+	std::vector<std::string> Workloads;
+
+	for(int I = 1; I < argc; ++I) {
+		std::string Option = argv[I];
+		if(I + 1 >= argc) {
+			std::cerr << "Missing value for " << Option << std::endl;
+			return 1;
+		}
+		const char* Value = argv[++I];
+		if(Option == "--preload") Config.Preload = atoi(Value);
+		else if(Option == "--ops") Config.Ops = atoi(Value);
+		else if(Option == "--reps") Config.Repetitions = atoi(Value);
+		else if(Option == "--warmup") Config.Warmup = atoi(Value);
+		else if(Option == "--threads") Config.MaxThreads = atoi(Value);
+		else if(Option == "--skew") Config.ZipfSkew = atof(Value);
+		else if(Option == "--table") Tables.push_back(Value);
+		else if(Option == "--workload") Workloads.push_back(Value);
+		else if(Option == "--csv") CsvPath = Value;
+		else if(Option == "--json") JsonPath = Value;
+		else {
+			std::cerr << "Unknown option " << Option << std::endl;
+			return 1;
+		}
+	}
+
+	// Name, key pattern, share of reads that hit, share of operations that are reads
+	Workload All[] = {
+		{"seq-read",          SEQUENTIAL_KEYS, 1.0, 1.0},
+		{"uniform-read",      UNIFORM_KEYS,    1.0, 1.0},
+		{"uniform-read-miss", UNIFORM_KEYS,    0.0, 1.0},
+		{"uniform-read-50hit",UNIFORM_KEYS,    0.5, 1.0},
+		{"zipf-read",         ZIPF_KEYS,       1.0, 1.0},
+		{"uniform-90read",    UNIFORM_KEYS,    1.0, 0.9},
+		{"zipf-50read",       ZIPF_KEYS,       1.0, 0.5},
+	};
+
+	BenchmarkSuite Suite(Config);
+	for(size_t W = 0; W < sizeof(All) / sizeof(All[0]); ++W) {
+		if(!selected(Workloads, All[W].Name))
+			continue;
+		if(selected(Tables, "chaining"))
+			Suite.run<ChainingHash<int, int>>("chaining", All[W], false);
+		if(selected(Tables, "probing"))
+			Suite.run<ProbingHash<int, int>>("probing", All[W], false);
+		if(selected(Tables, "probing-packed"))
+			Suite.run<ProbingHash<int, int, MixHash<int>, PrimeSize, PackedSlots>>("probing-packed", All[W], false);
+		if(selected(Tables, "probing-hugepage"))
+			Suite.run<ProbingHash<int, int, MixHash<int>, PrimeSize, PairSlots, HugePageAllocator<int>>>("probing-hugepage", All[W], false);
+		if(selected(Tables, "parallel-probing"))
+			Suite.run<ParallelProbingHash<int, int>>("parallel-probing", All[W], true);
+		if(selected(Tables, "swiss"))
+			Suite.run<SwissHash<int, int>>("swiss", All[W], false);
+		if(selected(Tables, "robin-hood"))
+			Suite.run<RobinHoodHash<int, int>>("robin-hood", All[W], false);
+		if(selected(Tables, "bucket-chaining"))
+			Suite.run<BucketChainingHash<int, int>>("bucket-chaining", All[W], false);
+		if(selected(Tables, "cuckoo"))
+			Suite.run<CuckooHash<int, int>>("cuckoo", All[W], false);
+	}
+
+	Suite.write_csv(CsvPath);
+	Suite.write_json(JsonPath);
+	std::cout << Suite.results().size() << " results written to " << CsvPath << " and " << JsonPath << std::endl;
+	return 0;
+}
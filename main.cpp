@@ -26,19 +26,106 @@
 #include "ChainingHash.hpp"
 #include "ProbingHash.hpp"
 #include "ParallelProbingHash.hpp"
+#include "SwissHash.hpp"
+#include "RobinHoodHash.hpp"
+#include "BucketChainingHash.hpp"
+#include "CuckooHash.hpp"
+#include "StringHash.hpp"
+#include "HugePageAllocator.hpp"
+#include "PerfCounters.hpp"
+#include "StreamLoader.hpp"
 
 #include <omp.h>
 #include <iostream>
 #include <fstream>
 #include <iomanip>
+#include <vector>
+#include <numeric>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <atomic>
+#include <string>
 
 #define NUM_THREADS 12  // update this value with the number of cores in your system. 
 
+// Times lookups of keys 0 – n-1. With a concrete table every call down to
+// the hash resolves at compile time; through Hash<K,V>& each one is a
+// virtual call. Kept out of line so the compiler cannot see what a Hash&
+// really is and devirtualize it anyway.
+template<typename Table>
+__attribute__((noinline)) double timeLookups(Table& T, int n)
+{
+	double startTime = omp_get_wtime();
+	for(int I = 0; I < n; ++I) {
+		T[I];
+	}
+	return omp_get_wtime() - startTime;
+}
+
+// Load factors print with two decimals. The stream's format is put back
+// afterwards, so the timings that follow keep their full precision.
+static void printLoadFactor(std::ostream& Out, float LoadFactor)
+{
+	std::ios::fmtflags Flags = Out.flags();
+	std::streamsize Precision = Out.precision();
+	Out << std::fixed << std::setprecision(2) << LoadFactor << std::endl;
+	Out.flags(Flags);
+	Out.precision(Precision);
+}
+
+// Every heap allocation in the program, for the allocations-per-insert
+// numbers below. Out of line so GCC does not pair an inlined free() with a
+// new-expression and warn about a mismatch.
+static std::atomic<long> Allocations(0);
+
+__attribute__((noinline)) void* operator new(size_t Size)
+{
+	Allocations.fetch_add(1, std::memory_order_relaxed);
+	if(void* P = std::malloc(Size == 0 ? 1 : Size))
+		return P;
+	throw std::bad_alloc();
+}
+
+__attribute__((noinline)) void operator delete(void* P) noexcept
+{
+	std::free(P);
+}
+
+__attribute__((noinline)) void operator delete(void* P, size_t) noexcept
+{
+	std::free(P);
+}
+
+// Heap allocations per insert of Words into a fresh table, growth included:
+// emplace() from lvalues copies the key and the value once each, while
+// try_emplace() builds the one value in place and never copies the key
+template<typename Table>
+double allocationsPerInsert(const std::vector<std::string>& Words, bool InPlace)
+{
+	Table T;
+	long Before = Allocations.load();
+	for(size_t I = 0; I < Words.size(); ++I) {
+		if(InPlace)
+			T.try_emplace(Words[I], Words[I]);
+		else
+			T.emplace(Words[I], Words[I]);
+	}
+	return (double)(Allocations.load() - Before) / Words.size();
+}
+
 int main()
 {
 	std::ofstream outputStream;
 	double startTime = 0.0;
 	double endTime = 0.0;
+	// Keys 0 – 999,999 for the batched lookups, and where their values land
+	std::vector<int> BatchKeys(1000000);
+	std::vector<int*> BatchValues(1000000);
+	std::iota(BatchKeys.begin(), BatchKeys.end(), 0);
+	// Hardware counters (cycles, instructions, cache and branch misses) for the
+	// 1M-operation phases; a single search or delete is too short to count
+	PerfCounters Perf;
 	/*Task I (a)- ChainingHash table*/
 	outputStream.open("HashAnalysis.txt");
 		//  create an object of type ChainingHash 
@@ -46,13 +133,16 @@ int main()
 		ChainingHash<int, int> CHash;
 		// In order, insert values with keys 1 – 1,000,000. For simplicity, the key and value stored are the same. 
 		startTime = omp_get_wtime();
+		Perf.start();
 		for(int I = 0; I < 1000000; ++I) {
 			CHash.emplace(I, I);
 		}
+		Perf.stop();
 		endTime = omp_get_wtime();
 		// Report the total amount of time, in seconds, required to insert the values to ChainingHash table. Write the results to a file called “HashAnalysis.txt”. 
 		outputStream << "Chaining Insertion Time: ";
 		outputStream << (endTime - startTime) << " Seconds" << std::endl;
+		outputStream << "Chaining Insertion Counters: " << Perf.report(1000000) << std::endl;
 		// Search for the value with key 177 in ChainingHash table. Report the time required to find the value in each table by writing it to the “HashAnalysis.txt” file. 
 		startTime = omp_get_wtime();
 		CHash[177];
@@ -61,10 +151,31 @@ int main()
 		outputStream << (endTime - startTime) << " Seconds" << std::endl;
 		// Search for the value with key 2,000,000 in ChainingHash table. Report the time required to find the value in each table by writing it to the file.  
 		startTime = omp_get_wtime();
-		CHash[2000000];
+		try {
+			CHash[2000000];
+		} catch(const std::out_of_range&) {}
 		endTime = omp_get_wtime();
 		outputStream << "Chaining Failed Search Time: ";
 		outputStream << (endTime - startTime) << " Seconds" << std::endl;
+		// Look up every key one at a time, then all of them with find_batch.
+		startTime = omp_get_wtime();
+		Perf.start();
+		for(int I = 0; I < 1000000; ++I) {
+			CHash[I];
+		}
+		Perf.stop();
+		endTime = omp_get_wtime();
+		outputStream << "Chaining Lookup Time(1M keys, one at a time): ";
+		outputStream << (endTime - startTime) << " Seconds" << std::endl;
+		outputStream << "Chaining Lookup Counters(1M keys, one at a time): " << Perf.report(1000000) << std::endl;
+		startTime = omp_get_wtime();
+		Perf.start();
+		CHash.find_batch(BatchKeys.data(), BatchKeys.size(), BatchValues.data());
+		Perf.stop();
+		endTime = omp_get_wtime();
+		outputStream << "Chaining Batch Lookup Time(1M keys): ";
+		outputStream << (endTime - startTime) << " Seconds" << std::endl;
+		outputStream << "Chaining Batch Lookup Counters(1M keys): " << Perf.report(1000000) << std::endl;
 		// Remove the value with key 177 from ChainingHash table. Report the time required to remove the value with in each table by writing it to the file.  
 		startTime = omp_get_wtime();
 		CHash.erase(177);
@@ -77,7 +188,7 @@ int main()
 		outputStream << "Chaining Bucket Count: ";
 		outputStream << CHash.bucket_count() << std::endl;
 		outputStream << "Chaining Load Factor: ";
-		outputStream << std::fixed << std::setprecision(2) << CHash.load_factor() << std::endl;
+		printLoadFactor(outputStream, CHash.load_factor());
 
 		outputStream << std::endl;
 	/*Task I (b) - ProbingHash table (using Linear Probing) */
@@ -86,13 +197,36 @@ int main()
 		ProbingHash<int, int> PHash;
 		// In order, insert values with keys 1 – 1,000,000. For simplicity, the key and value stored are the same.
 		startTime = omp_get_wtime();
+		Perf.start();
 		for(int I = 0; I < 1000000; ++I) {
 			PHash.emplace(I, I);
 		}
+		Perf.stop();
 		endTime = omp_get_wtime();
 		// Report the total amount of time, in seconds, required to insert the values to ProbingHash table. Write the results to a file called “HashAnalysis.txt”. 
 		outputStream << "Probing Insertion Time: ";
 		outputStream << (endTime - startTime) << " Seconds" << std::endl;
+		outputStream << "Probing Insertion Counters: " << Perf.report(1000000) << std::endl;
+		// The same insertions with room reserved up front (no rehash at all), then growing by half instead of doubling
+		ProbingHash<int, int> PReserved;
+		ProbingHash<int, int, MixHash<int>, ThreeHalvesSize> PThreeHalves;
+		PReserved.reserve(1000000);
+		startTime = omp_get_wtime();
+		for(int I = 0; I < 1000000; ++I) {
+			PReserved.emplace(I, I);
+		}
+		endTime = omp_get_wtime();
+		outputStream << "Probing Insertion Time(reserved): ";
+		outputStream << (endTime - startTime) << " Seconds" << std::endl;
+		startTime = omp_get_wtime();
+		for(int I = 0; I < 1000000; ++I) {
+			PThreeHalves.emplace(I, I);
+		}
+		endTime = omp_get_wtime();
+		outputStream << "Probing Insertion Time(1.5x growth): ";
+		outputStream << (endTime - startTime) << " Seconds" << std::endl;
+		outputStream << "Probing Bucket Count(reserved / 1.5x growth): ";
+		outputStream << PReserved.bucket_count() << " / " << PThreeHalves.bucket_count() << std::endl;
 		// Search for the value with key 177 in ProbingHash table. Report the time required to find the value in each table by writing it to the “HashAnalysis.txt” file. 
 		startTime = omp_get_wtime();
 		PHash[177];
@@ -101,10 +235,98 @@ int main()
 		outputStream << (endTime - startTime) << " Seconds" << std::endl;
 		// Search for the value with key 2,000,000 in ProbingHash table. Report the time required to find the value in each table by writing it to the file.  
 		startTime = omp_get_wtime();
-		PHash[2000000];
+		try {
+			PHash[2000000];
+		} catch(const std::out_of_range&) {}
 		endTime = omp_get_wtime();
 		outputStream << "Probing Failed Search Time: ";
 		outputStream << (endTime - startTime) << " Seconds" << std::endl;
+		// Look up every key one at a time, then all of them with find_batch.
+		startTime = omp_get_wtime();
+		Perf.start();
+		for(int I = 0; I < 1000000; ++I) {
+			PHash[I];
+		}
+		Perf.stop();
+		endTime = omp_get_wtime();
+		outputStream << "Probing Lookup Time(1M keys, one at a time): ";
+		outputStream << (endTime - startTime) << " Seconds" << std::endl;
+		outputStream << "Probing Lookup Counters(1M keys, one at a time): " << Perf.report(1000000) << std::endl;
+		startTime = omp_get_wtime();
+		Perf.start();
+		PHash.find_batch(BatchKeys.data(), BatchKeys.size(), BatchValues.data());
+		Perf.stop();
+		endTime = omp_get_wtime();
+		outputStream << "Probing Batch Lookup Time(1M keys): ";
+		outputStream << (endTime - startTime) << " Seconds" << std::endl;
+		outputStream << "Probing Batch Lookup Counters(1M keys): " << Perf.report(1000000) << std::endl;
+		// The same lookups on the concrete table, then through the virtual Hash<K,V> interface
+		HashAdapter<ProbingHash<int, int>> PAdapter(PHash);
+		outputStream << "Probing Lookup Time(1M keys, static interface): ";
+		outputStream << timeLookups(PHash, 1000000) << " Seconds" << std::endl;
+		outputStream << "Probing Lookup Time(1M keys, through Hash<K,V>): ";
+		outputStream << timeLookups<Hash<int, int>>(PAdapter, 1000000) << " Seconds" << std::endl;
+		// Save the table as a snapshot, map it into a fresh table (a warm restart) and look every key up there
+		startTime = omp_get_wtime();
+		PHash.save("ProbingHash.snapshot");
+		endTime = omp_get_wtime();
+		outputStream << "Probing Snapshot Save Time: ";
+		outputStream << (endTime - startTime) << " Seconds" << std::endl;
+		ProbingHash<int, int> PMapped;
+		startTime = omp_get_wtime();
+		PMapped.load_mmap("ProbingHash.snapshot");
+		endTime = omp_get_wtime();
+		outputStream << "Probing Snapshot Load Time(mmap): ";
+		outputStream << (endTime - startTime) << " Seconds" << std::endl;
+		outputStream << "Probing Lookup Time(1M keys, mapped snapshot): ";
+		outputStream << timeLookups(PMapped, 1000000) << " Seconds" << std::endl;
+		std::remove("ProbingHash.snapshot");
+		// The same keys with the packed slot layout: 2-bit slot states in bitsets beside a dense value array
+		ProbingHash<int, int, MixHash<int>, PrimeSize, PackedSlots> PPacked;
+		startTime = omp_get_wtime();
+		Perf.start();
+		for(int I = 0; I < 1000000; ++I) {
+			PPacked.emplace(I, I);
+		}
+		Perf.stop();
+		endTime = omp_get_wtime();
+		outputStream << "Probing Packed Insertion Time: ";
+		outputStream << (endTime - startTime) << " Seconds" << std::endl;
+		outputStream << "Probing Packed Insertion Counters: " << Perf.report(1000000) << std::endl;
+		Perf.start();
+		double PackedLookups = timeLookups(PPacked, 1000000);
+		Perf.stop();
+		outputStream << "Probing Packed Lookup Time(1M keys, one at a time): ";
+		outputStream << PackedLookups << " Seconds" << std::endl;
+		outputStream << "Probing Packed Lookup Counters(1M keys, one at a time): " << Perf.report(1000000) << std::endl;
+		outputStream << "Probing Bytes per Slot(pair / packed): ";
+		outputStream << PairSlots<int>::bytes_per_slot() << " / " << PackedSlots<int>::bytes_per_slot() << std::endl;
+		// Grow the same keys into 16M slots with the default allocator, then with huge pages. Mapped memory is
+		// already zero, so the HugePageAllocator table skips initializing its new slot array.
+		ProbingHash<int, int> PGrow;
+		ProbingHash<int, int, MixHash<int>, PrimeSize, PairSlots, HugePageAllocator<int>> PHuge;
+		for(int I = 0; I < 1000000; ++I) {
+			PGrow.emplace(I, I);
+			PHuge.emplace(I, I);
+		}
+		startTime = omp_get_wtime();
+		Perf.start();
+		PGrow.rehash(16000000);
+		Perf.stop();
+		endTime = omp_get_wtime();
+		outputStream << "Probing Resize Time(16M slots): ";
+		outputStream << (endTime - startTime) << " Seconds" << std::endl;
+		outputStream << "Probing Resize Counters(16M slots): " << Perf.report(1000000) << std::endl;
+		startTime = omp_get_wtime();
+		Perf.start();
+		PHuge.rehash(16000000);
+		Perf.stop();
+		endTime = omp_get_wtime();
+		outputStream << "Probing Huge Page Resize Time(16M slots): ";
+		outputStream << (endTime - startTime) << " Seconds" << std::endl;
+		outputStream << "Probing Huge Page Resize Counters(16M slots): " << Perf.report(1000000) << std::endl;
+		outputStream << "Probing Lookup Time(1M keys, 16M slots, default / huge pages): ";
+		outputStream << timeLookups(PGrow, 1000000) << " / " << timeLookups(PHuge, 1000000) << " Seconds" << std::endl;
 		// Remove the value with key 177 from ProbingHash table. Report the time required to remove the value with in each table by writing it to the file.  
 		startTime = omp_get_wtime();
 		PHash.erase(177);
@@ -117,10 +339,188 @@ int main()
 		outputStream << "Probing Bucket Count: ";
 		outputStream << PHash.bucket_count() << std::endl;
 		outputStream << "Probing Load Factor: ";
-		outputStream << std::fixed << std::setprecision(2) << PHash.load_factor() << std::endl;
+		printLoadFactor(outputStream, PHash.load_factor());
+		
+		outputStream << std::endl;
+	/*Task I (c) - SwissHash table (group probing over control bytes) */
+
+		//  create an object of type SwissHash 
+		SwissHash<int, int> SHash;
+		// In order, insert values with keys 1 – 1,000,000. For simplicity, the key and value stored are the same.
+		startTime = omp_get_wtime();
+		Perf.start();
+		for(int I = 0; I < 1000000; ++I) {
+			SHash.emplace(I, I);
+		}
+		Perf.stop();
+		endTime = omp_get_wtime();
+		outputStream << "Swiss Insertion Time: ";
+		outputStream << (endTime - startTime) << " Seconds" << std::endl;
+		outputStream << "Swiss Insertion Counters: " << Perf.report(1000000) << std::endl;
+		// Search for the value with key 177 in SwissHash table.
+		startTime = omp_get_wtime();
+		SHash[177];
+		endTime = omp_get_wtime();
+		outputStream << "Swiss Search Time: ";
+		outputStream << (endTime - startTime) << " Seconds" << std::endl;
+		// Search for the value with key 2,000,000 in SwissHash table.
+		startTime = omp_get_wtime();
+		try {
+			SHash[2000000];
+		} catch(const std::out_of_range&) {}
+		endTime = omp_get_wtime();
+		outputStream << "Swiss Failed Search Time: ";
+		outputStream << (endTime - startTime) << " Seconds" << std::endl;
+		// Remove the value with key 177 from SwissHash table.
+		startTime = omp_get_wtime();
+		SHash.erase(177);
+		endTime = omp_get_wtime();
+		outputStream << "Swiss Deletion Time: ";
+		outputStream << (endTime - startTime) << " Seconds" << std::endl;
+		// Also, write to the file the final size, bucket count, and load factor of the hash for SwissHash table. 
+		outputStream << "Swiss Table Size: ";
+		outputStream << SHash.size() << std::endl;
+		outputStream << "Swiss Bucket Count: ";
+		outputStream << SHash.bucket_count() << std::endl;
+		outputStream << "Swiss Load Factor: ";
+		printLoadFactor(outputStream, SHash.load_factor());
+		
+		outputStream << std::endl;
+	/*Task I (d) - RobinHoodHash table (Robin Hood linear probing) */
+
+		//  create an object of type RobinHoodHash 
+		RobinHoodHash<int, int> RHash;
+		// In order, insert values with keys 1 – 1,000,000. For simplicity, the key and value stored are the same.
+		startTime = omp_get_wtime();
+		Perf.start();
+		for(int I = 0; I < 1000000; ++I) {
+			RHash.emplace(I, I);
+		}
+		Perf.stop();
+		endTime = omp_get_wtime();
+		outputStream << "Robin Hood Insertion Time: ";
+		outputStream << (endTime - startTime) << " Seconds" << std::endl;
+		outputStream << "Robin Hood Insertion Counters: " << Perf.report(1000000) << std::endl;
+		// Search for the value with key 177 in RobinHoodHash table.
+		startTime = omp_get_wtime();
+		RHash[177];
+		endTime = omp_get_wtime();
+		outputStream << "Robin Hood Search Time: ";
+		outputStream << (endTime - startTime) << " Seconds" << std::endl;
+		// Search for the value with key 2,000,000 in RobinHoodHash table.
+		startTime = omp_get_wtime();
+		try {
+			RHash[2000000];
+		} catch(const std::out_of_range&) {}
+		endTime = omp_get_wtime();
+		outputStream << "Robin Hood Failed Search Time: ";
+		outputStream << (endTime - startTime) << " Seconds" << std::endl;
+		// Remove the value with key 177 from RobinHoodHash table.
+		startTime = omp_get_wtime();
+		RHash.erase(177);
+		endTime = omp_get_wtime();
+		outputStream << "Robin Hood Deletion Time: ";
+		outputStream << (endTime - startTime) << " Seconds" << std::endl;
+		// Also, write to the file the final size, bucket count, and load factor of the hash for RobinHoodHash table. 
+		outputStream << "Robin Hood Table Size: ";
+		outputStream << RHash.size() << std::endl;
+		outputStream << "Robin Hood Bucket Count: ";
+		outputStream << RHash.bucket_count() << std::endl;
+		outputStream << "Robin Hood Load Factor: ";
+		printLoadFactor(outputStream, RHash.load_factor());
+		
+		outputStream << std::endl;
+	/*Task I (e) - BucketChainingHash table (cache-line buckets) */
+
+		//  create an object of type BucketChainingHash 
+		BucketChainingHash<int, int> BHash;
+		// In order, insert values with keys 1 – 1,000,000. For simplicity, the key and value stored are the same.
+		startTime = omp_get_wtime();
+		Perf.start();
+		for(int I = 0; I < 1000000; ++I) {
+			BHash.emplace(I, I);
+		}
+		Perf.stop();
+		endTime = omp_get_wtime();
+		outputStream << "Bucket Chaining Insertion Time: ";
+		outputStream << (endTime - startTime) << " Seconds" << std::endl;
+		outputStream << "Bucket Chaining Insertion Counters: " << Perf.report(1000000) << std::endl;
+		// Search for the value with key 177 in BucketChainingHash table.
+		startTime = omp_get_wtime();
+		BHash[177];
+		endTime = omp_get_wtime();
+		outputStream << "Bucket Chaining Search Time: ";
+		outputStream << (endTime - startTime) << " Seconds" << std::endl;
+		// Search for the value with key 2,000,000 in BucketChainingHash table.
+		startTime = omp_get_wtime();
+		try {
+			BHash[2000000];
+		} catch(const std::out_of_range&) {}
+		endTime = omp_get_wtime();
+		outputStream << "Bucket Chaining Failed Search Time: ";
+		outputStream << (endTime - startTime) << " Seconds" << std::endl;
+		// Remove the value with key 177 from BucketChainingHash table.
+		startTime = omp_get_wtime();
+		BHash.erase(177);
+		endTime = omp_get_wtime();
+		outputStream << "Bucket Chaining Deletion Time: ";
+		outputStream << (endTime - startTime) << " Seconds" << std::endl;
+		// Also, write to the file the final size, bucket count, and load factor of the hash for BucketChainingHash table. 
+		outputStream << "Bucket Chaining Table Size: ";
+		outputStream << BHash.size() << std::endl;
+		outputStream << "Bucket Chaining Bucket Count: ";
+		outputStream << BHash.bucket_count() << std::endl;
+		outputStream << "Bucket Chaining Load Factor: ";
+		printLoadFactor(outputStream, BHash.load_factor());
+		
+		outputStream << std::endl;
+	/*Task I (f) - CuckooHash table (bucketized cuckoo hashing) */
+
+		//  create an object of type CuckooHash 
+		CuckooHash<int, int> CuHash;
+		// In order, insert values with keys 1 – 1,000,000. For simplicity, the key and value stored are the same.
+		startTime = omp_get_wtime();
+		Perf.start();
+		for(int I = 0; I < 1000000; ++I) {
+			CuHash.emplace(I, I);
+		}
+		Perf.stop();
+		endTime = omp_get_wtime();
+		outputStream << "Cuckoo Insertion Time: ";
+		outputStream << (endTime - startTime) << " Seconds" << std::endl;
+		outputStream << "Cuckoo Insertion Counters: " << Perf.report(1000000) << std::endl;
+		// Search for the value with key 177 in CuckooHash table.
+		startTime = omp_get_wtime();
+		CuHash[177];
+		endTime = omp_get_wtime();
+		outputStream << "Cuckoo Search Time: ";
+		outputStream << (endTime - startTime) << " Seconds" << std::endl;
+		// Search for the value with key 2,000,000 in CuckooHash table.
+		startTime = omp_get_wtime();
+		try {
+			CuHash[2000000];
+		} catch(const std::out_of_range&) {}
+		endTime = omp_get_wtime();
+		outputStream << "Cuckoo Failed Search Time: ";
+		outputStream << (endTime - startTime) << " Seconds" << std::endl;
+		// Remove the value with key 177 from CuckooHash table.
+		startTime = omp_get_wtime();
+		CuHash.erase(177);
+		endTime = omp_get_wtime();
+		outputStream << "Cuckoo Deletion Time: ";
+		outputStream << (endTime - startTime) << " Seconds" << std::endl;
+		// Also, write to the file the final size, bucket count, and load factor of the hash for CuckooHash table. 
+		outputStream << "Cuckoo Table Size: ";
+		outputStream << CuHash.size() << std::endl;
+		outputStream << "Cuckoo Bucket Count: ";
+		outputStream << CuHash.bucket_count() << std::endl;
+		outputStream << "Cuckoo Load Factor: ";
+		printLoadFactor(outputStream, CuHash.load_factor());
 		
 		outputStream << std::endl;
 	/*Task II -  ParallelProbingHash table (using Linear Probing) */
+		// Searches copy the value out through find(), which stays safe while other threads resize
+		int FoundValue = 0;
       
 	  // (a) Using a single thread:  
 		//  create an object of type ParallelProbingHash 
@@ -132,23 +532,26 @@ int main()
 		For simplicity, the key and value stored are the same.
         */
         startTime = omp_get_wtime();
+        Perf.start();
         #pragma omp parallel for
 		for(int I = 0; I < 1000000; ++I) {
 			PPHash1.emplace(I, I);
 		}
+		Perf.stop();
 		endTime = omp_get_wtime();
 		// Report the total amount of time, in seconds, required to insert the values to ParallelProbingHash table. Write the results to a file called “HashAnalysis.txt”. 
 		outputStream << "Parallel Probing Insertion Time(Single Thread): ";
 		outputStream << (endTime - startTime) << " Seconds" << std::endl;
+		outputStream << "Parallel Probing Insertion Counters(Single Thread): " << Perf.report(1000000) << std::endl;
 		// Search for the value with key 177 in ParallelProbingHash table. Report the time required to find the value in each table by writing it to the “HashAnalysis.txt” file. 
 		startTime = omp_get_wtime();
-		PPHash1[177];
+		PPHash1.find(177, FoundValue);
 		endTime = omp_get_wtime();
 		outputStream << "Parallel Probing Search Time(Single Thread): ";
 		outputStream << (endTime - startTime) << " Seconds" << std::endl;
 		// Search for the value with key 2,000,000 in ParallelProbingHash table. Report the time required to find the value in each table by writing it to the file.  
 		startTime = omp_get_wtime();
-		PPHash1[2000000];
+		PPHash1.find(2000000, FoundValue);
 		endTime = omp_get_wtime();
 		outputStream << "Parallel Probing Failed Search Time(Single Thread): ";
 		outputStream << (endTime - startTime) << " Seconds" << std::endl;
@@ -164,7 +567,7 @@ int main()
 		outputStream << "Parallel Probing Bucket Count(Single Thread): ";
 		outputStream << PPHash1.bucket_count() << std::endl;
 		outputStream << "Parallel Probing Load Factor(Single Thread): ";
-		outputStream << std::fixed << std::setprecision(2) << PPHash1.load_factor() << std::endl;
+		printLoadFactor(outputStream, PPHash1.load_factor());
 		
 		outputStream << std::endl;
 
@@ -173,28 +576,32 @@ int main()
 		ParallelProbingHash<int, int> PPHash2;
 		// i.	Change the number of threads to match the number of cores on your system 
 		omp_set_num_threads(NUM_THREADS);
+		PerfCounters ParallelPerf(NUM_THREADS);
 		/* In an OpenMP parallel region (#pragma omp parallel), in order, insert values with keys 1 – 1,000,000. 
 		Inside the parallel region make sure that the value for the iteration number of the loop is shared among all threads. 
 		For simplicity, the key and value stored are the same.
         */
         startTime = omp_get_wtime();
+        ParallelPerf.start();
         #pragma omp parallel for
 		for(int I = 0; I < 1000000; ++I) {
 			PPHash2.emplace(I, I);
 		}
+		ParallelPerf.stop();
 		endTime = omp_get_wtime();
 		// Report the total amount of time, in seconds, required to insert the values to ParallelProbingHash table. Write the results to a file called “HashAnalysis.txt”. 
 		outputStream << "Parallel Probing Insertion Time(12 Threads): ";
 		outputStream << (endTime - startTime) << " Seconds" << std::endl;
+		outputStream << "Parallel Probing Insertion Counters(12 Threads): " << ParallelPerf.report(1000000) << std::endl;
 		// Search for the value with key 177 in ParallelProbingHash table. Report the time required to find the value in each table by writing it to the “HashAnalysis.txt” file. 
 		startTime = omp_get_wtime();
-		PPHash2[177];
+		PPHash2.find(177, FoundValue);
 		endTime = omp_get_wtime();
 		outputStream << "Parallel Probing Search Time(12 Threads): ";
 		outputStream << (endTime - startTime) << " Seconds" << std::endl;
 		// Search for the value with key 2,000,000 in ParallelProbingHash table. Report the time required to find the value in each table by writing it to the file.  
 		startTime = omp_get_wtime();
-		PPHash2[2000000];
+		PPHash2.find(2000000, FoundValue);
 		endTime = omp_get_wtime();
 		outputStream << "Parallel Probing Failed Search Time(12 Threads): ";
 		outputStream << (endTime - startTime) << " Seconds" << std::endl;
@@ -210,8 +617,161 @@ int main()
 		outputStream << "Parallel Probing Bucket Count(12 Threads): ";
 		outputStream << PPHash2.bucket_count() << std::endl;
 		outputStream << "Parallel Probing Load Factor(12 Threads): ";
-		outputStream << std::fixed << std::setprecision(2) << PPHash2.load_factor() << std::endl;
+		printLoadFactor(outputStream, PPHash2.load_factor());
+		
+		outputStream << std::endl;
+
+	// (c) Bulk loading with build_from:
+		//  create an object of type ParallelProbingHash and the same 1,000,000 key/value pairs as an array
+		ParallelProbingHash<int, int> PPHash3;
+		std::vector<std::pair<int, int>> BulkData(1000000);
+		for(int I = 0; I < 1000000; ++I) {
+			BulkData[I] = std::make_pair(I, I);
+		}
+		// Size the table once, radix-partition the pairs by home slot and fill the partitions in parallel
+		startTime = omp_get_wtime();
+		ParallelPerf.start();
+		PPHash3.build_from(BulkData.data(), BulkData.size(), NUM_THREADS);
+		ParallelPerf.stop();
+		endTime = omp_get_wtime();
+		outputStream << "Parallel Probing Bulk Build Time(12 Threads): ";
+		outputStream << (endTime - startTime) << " Seconds" << std::endl;
+		outputStream << "Parallel Probing Bulk Build Counters(12 Threads): " << ParallelPerf.report(1000000) << std::endl;
+		outputStream << "Parallel Probing Table Size(Bulk Build): ";
+		outputStream << PPHash3.size() << std::endl;
+		outputStream << "Parallel Probing Bucket Count(Bulk Build): ";
+		outputStream << PPHash3.bucket_count() << std::endl;
+		outputStream << "Parallel Probing Load Factor(Bulk Build): ";
+		printLoadFactor(outputStream, PPHash3.load_factor());
 		
+		outputStream << std::endl;
+
+	// (d) Write-buffered inserts:
+		//  each thread collects its inserts in a private WriteBuffer and merges them into the shared table in batches sorted by home slot
+		ParallelProbingHash<int, int> PPHash4;
+		startTime = omp_get_wtime();
+		ParallelPerf.start();
+		#pragma omp parallel
+		{
+			WriteBuffer<ParallelProbingHash<int, int>> Buffer(PPHash4);
+			#pragma omp for
+			for(int I = 0; I < 1000000; ++I) {
+				Buffer.emplace(I, I);
+			}
+			Buffer.sync();
+		}
+		ParallelPerf.stop();
+		endTime = omp_get_wtime();
+		outputStream << "Parallel Probing Buffered Insertion Time(12 Threads): ";
+		outputStream << (endTime - startTime) << " Seconds" << std::endl;
+		outputStream << "Parallel Probing Buffered Insertion Counters(12 Threads): " << ParallelPerf.report(1000000) << std::endl;
+		outputStream << "Parallel Probing Table Size(Buffered): ";
+		outputStream << PPHash4.size() << std::endl;
+		
+		outputStream << std::endl;
+
+	/*Streaming ingestion from key/value dump files */
+		// Dump the same 1,000,000 pairs as text ("key value" lines) and as packed binary records
+		{
+			std::ofstream TextDump("HashDump.txt");
+			for(int I = 0; I < 1000000; ++I) {
+				TextDump << I << ' ' << I << '\n';
+			}
+			std::ofstream BinaryDump("HashDump.bin", std::ios::binary);
+			BinaryDump.write((const char*)BulkData.data(), BulkData.size() * sizeof(BulkData[0]));
+		}
+		// Read, parse and insert overlap: the file is read in chunks, parsed on worker threads and inserted in batches
+		ChainingHash<int, int> StreamChaining;
+		IngestResult Ingest = StreamLoader<ChainingHash<int, int>>(StreamChaining).load("HashDump.txt", TEXT_DUMP);
+		outputStream << "Chaining Stream Load(Text): " << Ingest.megabytes_per_second() << " MB/s, ";
+		outputStream << Ingest.Records << " records, " << StreamChaining.size() << " entries" << std::endl;
+		ProbingHash<int, int> StreamProbing;
+		Ingest = StreamLoader<ProbingHash<int, int>>(StreamProbing).load("HashDump.txt", TEXT_DUMP);
+		outputStream << "Probing Stream Load(Text): " << Ingest.megabytes_per_second() << " MB/s, ";
+		outputStream << Ingest.Records << " records, " << StreamProbing.size() << " entries" << std::endl;
+		// ParallelProbingHash takes concurrent inserts, so it gets several inserter threads
+		IngestConfig ParallelIngest;
+		ParallelIngest.Parsers = NUM_THREADS / 2;
+		ParallelIngest.Inserters = NUM_THREADS / 2;
+		ParallelProbingHash<int, int> StreamParallel;
+		Ingest = StreamLoader<ParallelProbingHash<int, int>>(StreamParallel, ParallelIngest).load("HashDump.txt", TEXT_DUMP);
+		outputStream << "Parallel Probing Stream Load(Text): " << Ingest.megabytes_per_second() << " MB/s, ";
+		outputStream << Ingest.Records << " records, " << StreamParallel.size() << " entries" << std::endl;
+		ParallelProbingHash<int, int> StreamBinary;
+		Ingest = StreamLoader<ParallelProbingHash<int, int>>(StreamBinary, ParallelIngest).load("HashDump.bin", BINARY_DUMP);
+		outputStream << "Parallel Probing Stream Load(Binary): " << Ingest.megabytes_per_second() << " MB/s, ";
+		outputStream << Ingest.Records << " records, " << StreamBinary.size() << " entries" << std::endl;
+		std::remove("HashDump.txt");
+		std::remove("HashDump.bin");
+
+		outputStream << std::endl;
+
+	/*Heavyweight values: heap allocations per insert with std::string keys and values */
+		// 40-odd characters, too long for the small-string buffer, so each string copy allocates.
+		// Growing only relinks nodes or moves strings, so it adds just the new bucket or slot arrays.
+		std::vector<std::string> Words(100000);
+		for(size_t I = 0; I < Words.size(); ++I) {
+			Words[I] = "session-" + std::to_string(I) + std::string(32, '-');
+		}
+		outputStream << "Chaining String Allocations per Insert(emplace / try_emplace): ";
+		outputStream << allocationsPerInsert<ChainingHash<std::string, std::string>>(Words, false) << " / ";
+		outputStream << allocationsPerInsert<ChainingHash<std::string, std::string>>(Words, true) << std::endl;
+		outputStream << "Probing String Allocations per Insert(emplace / try_emplace): ";
+		outputStream << allocationsPerInsert<ProbingHash<std::string, std::string>>(Words, false) << " / ";
+		outputStream << allocationsPerInsert<ProbingHash<std::string, std::string>>(Words, true) << std::endl;
+		outputStream << "Parallel Probing String Allocations per Insert(emplace / try_emplace): ";
+		outputStream << allocationsPerInsert<ParallelProbingHash<std::string, std::string>>(Words, false) << " / ";
+		outputStream << allocationsPerInsert<ParallelProbingHash<std::string, std::string>>(Words, true) << std::endl;
+
+		outputStream << std::endl;
+
+	/*String keys: StringHash against ProbingHash<std::string, std::string> */
+		// Half ticker-style symbols that fit in a slot, half session IDs that do not
+		std::vector<std::string> StringKeys(1000000);
+		for(size_t I = 0; I < StringKeys.size(); ++I) {
+			if(I % 2 == 0)
+				StringKeys[I] = "SYM" + std::to_string(I);
+			else
+				StringKeys[I] = "session-" + std::to_string(I) + std::string(32, '-');
+		}
+		StringHash<int> Strings;
+		startTime = omp_get_wtime();
+		for(size_t I = 0; I < StringKeys.size(); ++I) {
+			Strings.emplace(StringKeys[I], (int)I);
+		}
+		endTime = omp_get_wtime();
+		outputStream << "StringHash Insertion Time: " << endTime - startTime << " Seconds" << std::endl;
+		ProbingHash<std::string, std::string> ProbingStrings;
+		startTime = omp_get_wtime();
+		for(size_t I = 0; I < StringKeys.size(); ++I) {
+			ProbingStrings.emplace(StringKeys[I], StringKeys[I]);
+		}
+		endTime = omp_get_wtime();
+		outputStream << "Probing String Insertion Time: " << endTime - startTime << " Seconds" << std::endl;
+
+		// Lookups from a char buffer, as a parser would hand them over: StringHash
+		// takes a StringView of the buffer, ProbingHash needs a std::string built first
+		char KeyBuffer[64];
+		long Found = 0;
+		long Before = Allocations.load();
+		startTime = omp_get_wtime();
+		for(size_t I = 0; I < StringKeys.size(); ++I) {
+			size_t Length = StringKeys[I].copy(KeyBuffer, sizeof(KeyBuffer));
+			Found += Strings.count(StringView(KeyBuffer, Length));
+		}
+		endTime = omp_get_wtime();
+		outputStream << "StringHash Search Time(char buffer): " << endTime - startTime << " Seconds, ";
+		outputStream << (double)(Allocations.load() - Before) / StringKeys.size() << " allocations per lookup" << std::endl;
+		Before = Allocations.load();
+		startTime = omp_get_wtime();
+		for(size_t I = 0; I < StringKeys.size(); ++I) {
+			size_t Length = StringKeys[I].copy(KeyBuffer, sizeof(KeyBuffer));
+			Found += ProbingStrings.count(std::string(KeyBuffer, Length));
+		}
+		endTime = omp_get_wtime();
+		outputStream << "Probing String Search Time(char buffer): " << endTime - startTime << " Seconds, ";
+		outputStream << (double)(Allocations.load() - Before) / StringKeys.size() << " allocations per lookup" << std::endl;
+		outputStream << "String Keys Found: " << Found << " of " << 2 * StringKeys.size() << std::endl;
 		
 	outputStream.close();
 	return 0;